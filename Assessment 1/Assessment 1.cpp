@@ -7,14 +7,832 @@
  * @LastEditTime: 2020-04-09 13:33:15
  */
 
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <fstream>
 #include <iostream>
+#include <sstream>
+#include <stdexcept>
 #include <vector>
 
 #include "Utils.h"
 #include "CImg.h"
+#include "Equaliser.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <csignal>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // the flag does not exist on some systems (e.g. macOS), where ignoring SIGPIPE is enough
+#endif
+#endif
 
 using namespace cimg_library;
 
+typedef unsigned int standard; // use "unsigned int" as the standard data type to avoid integer overflow when processing some large images
+
+// load and build the device code in the specified context
+cl::Program build_program(const cl::Context& context)
+{
+	cl::Program::Sources sources;
+
+	AddSources(sources, "kernels/assessment1_kernels.cl");
+
+	cl::Program program(context, sources);
+
+	// build and debug the kernel code
+	try
+	{
+		program.build();
+	}
+	catch (const cl::Error& err)
+	{
+		std::cout << "Build Status: " << program.getBuildInfo<CL_PROGRAM_BUILD_STATUS>(context.getInfo<CL_CONTEXT_DEVICES>()[0]) << std::endl;
+		std::cout << "Build Options:\t" << program.getBuildInfo<CL_PROGRAM_BUILD_OPTIONS>(context.getInfo<CL_CONTEXT_DEVICES>()[0]) << std::endl;
+		std::cout << "Build Log:\t " << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(context.getInfo<CL_CONTEXT_DEVICES>()[0]) << std::endl;
+		throw err;
+	} // end try...catch
+
+	return program;
+} // end function build_program
+
+// get the execution time of a profiled command in nanoseconds (0 for a command which has not been enqueued)
+cl_ulong get_event_time(const cl::Event& event)
+{
+	if (!event())
+		return 0;
+
+	return event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+} // end function get_event_time
+
+// resources of a device taking part in the multi-device mode
+struct DeviceSlice
+{
+	cl::Device device;
+	cl::Context context;
+	cl::CommandQueue queue;
+	cl::Program program;
+	double throughput; // elements per nanosecond measured by the calibration run
+	size_t row_offset; // index of the first row of the slice
+	size_t rows; // number of rows of the slice
+	cl::Buffer buffer_host_image, buffer_input_image, buffer_H, buffer_LUT, buffer_output_image;
+	std::vector<standard> H; // partial histogram of the slice
+	cl::Event input_image_event, H_input_event, LUT_input_event, kernel0_event, kernel1_event, kernel4_event, output_image_event;
+};
+
+/*
+enqueue the histogram kernel matching the bit depth of an image slice;
+an 8-bit slice uses the optimised kernel with 1 work group per 256 elements, while a 16-bit slice uses the basic kernel
+*/
+void enqueue_histogram(DeviceSlice& slice, const cl::Buffer& buffer_image, const cl::Buffer& buffer_H, size_t elements, int bin_count, cl::Event* event)
+{
+	cl::Kernel kernel;
+
+	if (bin_count == 256)
+	{
+		size_t local_elements_8 = 256;
+		size_t global_elements_8 = elements;
+
+		if (global_elements_8 % local_elements_8)
+			global_elements_8 += (local_elements_8 - global_elements_8 % local_elements_8);
+
+		kernel = cl::Kernel(slice.program, "get_H_pro");
+		kernel.setArg(0, buffer_image);
+		kernel.setArg(1, buffer_H);
+		kernel.setArg(2, cl::Local(local_elements_8 * sizeof(standard))); // local memory size for a local histogram
+		kernel.setArg(3, (standard)elements);
+
+		slice.queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(global_elements_8), cl::NDRange(local_elements_8), NULL, event);
+	}
+	else
+	{
+		kernel = cl::Kernel(slice.program, "get_H_16");
+		kernel.setArg(0, buffer_image);
+		kernel.setArg(1, buffer_H);
+
+		slice.queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(elements), cl::NullRange, NULL, event);
+	} // end if...else
+} // end function enqueue_histogram
+
+/*
+apply histogram equalisation by splitting the rows of an image across the specified devices (multi-device mode and NUMA mode);
+the rows of the colour channels are stacked, so a planar image with "row_count" rows per channel is treated as "row_count * spectrum" rows;
+each device computes a partial histogram of its own slice, the partial histograms are reduced on the host,
+and the LUT is broadcast back so that every device applies it to its own slice;
+slice sizes are weighted by the histogram kernel throughput of each device measured by a quick calibration run;
+if "first_touch" is true (NUMA mode), each slice is copied into a buffer backed by host memory by a kernel on its own (sub-)device,
+so that the pages are first touched, and thus placed, on the NUMA node whose cores then read them
+*/
+template <typename T>
+void equalise_multi_device(const std::vector<cl::Device>& devices, const T* input_data, T* output_data, size_t row_elements, size_t row_count, int bin_count, int pixel_count, bool first_touch)
+{
+	std::vector<DeviceSlice> slices(devices.size());
+	size_t calibration_rows = std::max<size_t>(1, row_count / 16); // calibrate on roughly 1/16 of the image
+	size_t calibration_elements = calibration_rows * row_elements;
+	double total_throughput = 0;
+
+	if (devices.empty())
+		throw cl::Error(CL_DEVICE_NOT_FOUND, "equalise_multi_device");
+
+	// Step 0: calibrate each device with the histogram kernel on the leading rows of the image
+	for (size_t i = 0; i < slices.size(); i++)
+	{
+		DeviceSlice& slice = slices[i];
+		slice.device = devices[i];
+		slice.context = cl::Context({ slice.device });
+		slice.queue = cl::CommandQueue(slice.context, slice.device, CL_QUEUE_PROFILING_ENABLE);
+		slice.program = build_program(slice.context);
+
+		cl::Buffer buffer_sample(slice.context, CL_MEM_READ_ONLY, calibration_elements * sizeof(T));
+		cl::Buffer buffer_sample_H(slice.context, CL_MEM_READ_WRITE, bin_count * sizeof(standard));
+		cl::Event calibration_event;
+
+		slice.queue.enqueueWriteBuffer(buffer_sample, CL_TRUE, 0, calibration_elements * sizeof(T), input_data);
+		slice.queue.enqueueFillBuffer(buffer_sample_H, 0, 0, bin_count * sizeof(standard));
+		enqueue_histogram(slice, buffer_sample, buffer_sample_H, calibration_elements, bin_count, NULL); // warm-up run to exclude the JIT and first-touch costs
+		enqueue_histogram(slice, buffer_sample, buffer_sample_H, calibration_elements, bin_count, &calibration_event);
+		calibration_event.wait();
+
+		slice.throughput = (double)calibration_elements / std::max<cl_ulong>(1, get_event_time(calibration_event));
+		total_throughput += slice.throughput;
+	} // end for
+
+	// split the rows in proportion to the measured throughput; the last device takes the remaining rows
+	size_t assigned_rows = 0;
+
+	for (size_t i = 0; i < slices.size(); i++)
+	{
+		slices[i].row_offset = assigned_rows;
+		slices[i].rows = (i == slices.size() - 1) ? row_count - assigned_rows : (size_t)(row_count * slices[i].throughput / total_throughput);
+		assigned_rows += slices[i].rows;
+	} // end for
+
+	auto start_time = std::chrono::steady_clock::now();
+
+	// Step 1: compute a partial histogram of each slice (non-blocking, so all devices work at the same time)
+	for (DeviceSlice& slice : slices)
+	{
+		if (slice.rows == 0)
+			continue;
+
+		size_t slice_elements = slice.rows * row_elements;
+		size_t slice_size = slice_elements * sizeof(T);
+
+		slice.H.assign(bin_count, 0);
+		slice.buffer_H = cl::Buffer(slice.context, CL_MEM_READ_WRITE, bin_count * sizeof(standard));
+		slice.buffer_LUT = cl::Buffer(slice.context, CL_MEM_READ_ONLY, bin_count * sizeof(standard));
+
+		if (first_touch)
+		{
+			// the runtime allocates but does not touch the pages, so the copy kernel running on the sub-device touches them first
+			// the buffer over the input slice is read-only ("CL_MEM_READ_ONLY", and only the copy kernel reads it), so casting away "const" for the OpenCL API never leads to a write
+			slice.buffer_host_image = cl::Buffer(slice.context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, slice_size, const_cast<T*>(input_data + slice.row_offset * row_elements));
+			slice.buffer_input_image = cl::Buffer(slice.context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, slice_size);
+			slice.buffer_output_image = cl::Buffer(slice.context, CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR, slice_size);
+
+			cl::Kernel kernel0(slice.program, bin_count == 256 ? "copy_image_8" : "copy_image_16");
+
+			kernel0.setArg(0, slice.buffer_host_image);
+			kernel0.setArg(1, slice.buffer_input_image);
+
+			slice.queue.enqueueNDRangeKernel(kernel0, cl::NullRange, cl::NDRange(slice_elements), cl::NullRange, NULL, &slice.kernel0_event);
+		}
+		else
+		{
+			slice.buffer_input_image = cl::Buffer(slice.context, CL_MEM_READ_ONLY, slice_size);
+			slice.buffer_output_image = cl::Buffer(slice.context, CL_MEM_WRITE_ONLY, slice_size);
+
+			slice.queue.enqueueWriteBuffer(slice.buffer_input_image, CL_FALSE, 0, slice_size, input_data + slice.row_offset * row_elements, NULL, &slice.input_image_event);
+		} // end if...else
+
+		slice.queue.enqueueFillBuffer(slice.buffer_H, 0, 0, bin_count * sizeof(standard), NULL, &slice.H_input_event);
+		enqueue_histogram(slice, slice.buffer_input_image, slice.buffer_H, slice_elements, bin_count, &slice.kernel1_event);
+		slice.queue.enqueueReadBuffer(slice.buffer_H, CL_FALSE, 0, bin_count * sizeof(standard), &slice.H[0]);
+		slice.queue.flush();
+	} // end for
+
+	// Step 2: reduce the partial histograms on the host and get the LUT (same arithmetic as "get_CH_pro" and "get_lut")
+	std::vector<unsigned long long> H(bin_count, 0);
+
+	for (DeviceSlice& slice : slices)
+		if (slice.rows)
+		{
+			slice.queue.finish();
+
+			for (int i = 0; i < bin_count; i++)
+				H[i] += slice.H[i];
+		} // end if
+
+	std::vector<standard> LUT(bin_count);
+	unsigned long long cumulative = 0;
+
+	for (int i = 0; i < bin_count; i++)
+	{
+		cumulative += H[i];
+		LUT[i] = (standard)(((cumulative / 3) * (bin_count - 1)) / pixel_count); // an average histogram of the 3 colour channels' histograms is used
+	} // end for
+
+	// Step 3: broadcast the LUT and get the output slice on each device
+	for (DeviceSlice& slice : slices)
+	{
+		if (slice.rows == 0)
+			continue;
+
+		size_t slice_elements = slice.rows * row_elements;
+		cl::Kernel kernel4(slice.program, bin_count == 256 ? "get_processed_image_8" : "get_processed_image_16");
+
+		kernel4.setArg(0, slice.buffer_input_image);
+		kernel4.setArg(1, slice.buffer_LUT);
+		kernel4.setArg(2, slice.buffer_output_image);
+
+		slice.queue.enqueueWriteBuffer(slice.buffer_LUT, CL_FALSE, 0, bin_count * sizeof(standard), &LUT[0], NULL, &slice.LUT_input_event);
+		slice.queue.enqueueNDRangeKernel(kernel4, cl::NullRange, cl::NDRange(slice_elements), cl::NullRange, NULL, &slice.kernel4_event);
+		slice.queue.enqueueReadBuffer(slice.buffer_output_image, CL_FALSE, 0, slice_elements * sizeof(T), output_data + slice.row_offset * row_elements, NULL, &slice.output_image_event);
+		slice.queue.flush();
+	} // end for
+
+	for (DeviceSlice& slice : slices)
+		if (slice.rows)
+			slice.queue.finish();
+
+	auto end_time = std::chrono::steady_clock::now();
+
+	// display time in microseconds
+	for (size_t i = 0; i < slices.size(); i++)
+	{
+		DeviceSlice& slice = slices[i];
+
+		std::cout << "\nDevice " << i << ", " << slice.device.getInfo<CL_DEVICE_NAME>() << ": " << slice.rows << " row(s)" << std::endl;
+
+		if (slice.rows == 0)
+			continue;
+
+		// the first-touch copy kernel takes the place of the input image upload in NUMA mode
+		std::cout << "   Memory transfer time: " << (get_event_time(first_touch ? slice.kernel0_event : slice.input_image_event) + get_event_time(slice.H_input_event) + get_event_time(slice.LUT_input_event) + get_event_time(slice.output_image_event)) / 1000 << " us" << std::endl;
+		std::cout << "   Kernel execution time: " << (get_event_time(slice.kernel1_event) + get_event_time(slice.kernel4_event)) / 1000 << " us" << std::endl;
+	} // end for
+
+	std::cout << "\nProgram execution time (wall clock, all devices): " << std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count() << " us" << std::endl;
+} // end function equalise_multi_device
+
+/*
+get the intensity value at a percentile from a cumulative histogram, i.e. the smallest bin whose cumulative count reaches the percentile;
+"inclusive" should be false for the basic cumulative histogram kernel whose element i counts the values below bin i
+*/
+int get_percentile(const std::vector<standard>& CH, double percentile, int pixel_count, bool inclusive)
+{
+	double target = percentile / 100 * pixel_count;
+
+	for (size_t i = 0; i < CH.size(); i++)
+	{
+		double count = inclusive ? CH[i] : (i + 1 < CH.size() ? CH[i + 1] : pixel_count);
+
+		if (count >= target)
+			return (int)i;
+	} // end for
+
+	return (int)CH.size() - 1;
+} // end function get_percentile
+
+/*
+get the number of bins covering the actual value range of an image, i.e. the smallest power of 2 above its maximum value (at least 256);
+e.g. 10-bit, 12-bit, and 14-bit data stored as 16-bit images gets 1024, 4096, and 16384 bins instead of 65536
+*/
+int get_adaptive_bin_count(int max_value)
+{
+	int bin_count = 256;
+
+	while (bin_count <= max_value)
+		bin_count *= 2;
+
+	return bin_count;
+} // end function get_adaptive_bin_count
+
+/*
+find the frame number token "%d" or "%0Nd" (N from 0 to 9) in a frame pattern, e.g. "frame_%04d.ppm";
+the pattern is invalid if it has no token, more than one, or any other "%", as it is never used as a format string
+*/
+bool find_frame_token(const string& pattern, size_t& token_start, size_t& token_end, int& width)
+{
+	token_start = string::npos;
+
+	for (size_t i = 0; i < pattern.size(); i++)
+	{
+		if (pattern[i] != '%')
+			continue;
+
+		if (token_start != string::npos)
+			return false; // more than one token
+
+		if (pattern.compare(i, 2, "%d") == 0)
+		{
+			width = 0;
+			token_end = i + 2;
+		}
+		else if (i + 3 < pattern.size() && pattern[i + 1] == '0' && isdigit((unsigned char)pattern[i + 2]) && pattern[i + 3] == 'd')
+		{
+			width = pattern[i + 2] - '0';
+			token_end = i + 4;
+		}
+		else
+			return false;
+
+		token_start = i;
+		i = token_end - 1;
+	} // end for
+
+	return token_start != string::npos;
+} // end function find_frame_token
+
+// get the path of a numbered frame by replacing the token of a frame pattern with the zero-padded frame number
+string get_frame_path(const string& pattern, int frame)
+{
+	size_t token_start, token_end;
+	int width;
+
+	if (!find_frame_token(pattern, token_start, token_end, width))
+		throw std::runtime_error("Invalid frame pattern \"" + pattern + "\" (a single \"%d\" or \"%0Nd\" is expected).");
+
+	string number = std::to_string(frame);
+
+	if ((int)number.size() < width)
+		number.insert(0, width - number.size(), '0');
+
+	return "images/" + pattern.substr(0, token_start) + number + pattern.substr(token_end);
+} // end function get_frame_path
+
+// get the output path of a numbered frame, which is saved under the folder "images" with the base name of the frame file
+string get_frame_output_path(const string& pattern, int frame)
+{
+	string path = get_frame_path(pattern, frame);
+
+	return "images/equalised_" + path.substr(path.find_last_of("/\\") + 1);
+} // end function get_frame_output_path
+
+/*
+apply histogram equalisation to numbered frames (from 1) with all buffers kept resident (video mode);
+each frame updates an exponentially smoothed histogram to avoid flicker, and the LUT kernel skips itself on the device when the smoothed histogram
+changes by less than a set amount since the last LUT, so most frames only run the histogram, smoothing, and apply kernels;
+frame N + 1 is read from the file and uploaded on a separate queue while frame N is processed, and the output of each frame is saved as "images/equalised_<base name of the frame file>"
+*/
+template <typename T>
+void run_video(const cl::Context& context, const cl::Program& program, const string& pattern, int width, int height, int spectrum, int bin_count)
+{
+	const float alpha = 0.25f; // the weight of a new frame in the smoothed histogram
+	const double threshold = 0.01; // the LUT is only updated when at least 1% of the image elements move between bins
+	cl::Device device = context.getInfo<CL_CONTEXT_DEVICES>()[0];
+	cl::CommandQueue queue(context, CL_QUEUE_PROFILING_ENABLE); // the queue for kernels and downloads
+	cl::CommandQueue upload_queue(context); // the queue for uploads, so that an upload can overlap with the kernels of the previous frame
+	size_t image_elements = (size_t)width * height * spectrum;
+	size_t image_size = image_elements * sizeof(T);
+	cl_uint threshold_elements = (cl_uint)(threshold * image_elements);
+	size_t local_elements_8 = 256;
+	size_t global_elements_8 = (image_elements + local_elements_8 - 1) / local_elements_8 * local_elements_8;
+	size_t local_elements_lut = 1;
+
+	// the scan of the LUT kernel requires the number of local elements to be a power of 2
+	while (local_elements_lut * 2 <= cl::Kernel(program, "get_video_lut").getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device) && local_elements_lut < 256)
+		local_elements_lut *= 2;
+
+	// 2 input buffers and host images take turns, so that the next frame can be loaded and uploaded while the current one is processed
+	cl::Buffer buffer_input_image[2] = { cl::Buffer(context, CL_MEM_READ_ONLY, image_size), cl::Buffer(context, CL_MEM_READ_ONLY, image_size) };
+	cl::Buffer buffer_H(context, CL_MEM_READ_WRITE, bin_count * sizeof(standard));
+	cl::Buffer buffer_H_smoothed(context, CL_MEM_READ_WRITE, bin_count * sizeof(float));
+	cl::Buffer buffer_H_reference(context, CL_MEM_READ_WRITE, bin_count * sizeof(float)); // the smoothed histogram the current LUT was built from
+	cl::Buffer buffer_change(context, CL_MEM_READ_WRITE, sizeof(standard));
+	cl::Buffer buffer_LUT(context, CL_MEM_READ_WRITE, bin_count * sizeof(standard));
+	cl::Buffer buffer_output_image(context, CL_MEM_WRITE_ONLY, image_size);
+	CImg<T> input_images[2], output_images[2];
+	cl::Event upload_events[2], output_events[2];
+
+	queue.enqueueFillBuffer(buffer_H_reference, 0.0f, 0, bin_count * sizeof(float));
+
+	cl::Kernel kernel1(program, sizeof(T) == 1 ? "get_H_pro" : "get_H_16"); // Step 1: get a histogram of the frame
+	cl::Kernel kernel2(program, "smooth_H"); // Step 2: update the smoothed histogram
+	cl::Kernel kernel3(program, "get_video_lut"); // Step 3: get an LUT unless the smoothed histogram hardly changes
+	cl::Kernel kernel4(program, sizeof(T) == 1 ? "get_processed_image_8" : "get_processed_image_16"); // Step 4: get the output frame according to the LUT
+
+	kernel1.setArg(1, buffer_H);
+
+	if (sizeof(T) == 1)
+	{
+		kernel1.setArg(2, cl::Local(local_elements_8 * sizeof(standard))); // local memory size for a local histogram
+		kernel1.setArg(3, (standard)image_elements);
+	} // end if
+
+	kernel2.setArg(0, buffer_H);
+	kernel2.setArg(1, buffer_H_smoothed);
+	kernel2.setArg(2, buffer_H_reference);
+	kernel2.setArg(3, buffer_change);
+
+	kernel3.setArg(0, buffer_H_smoothed);
+	kernel3.setArg(1, buffer_H_reference);
+	kernel3.setArg(2, buffer_LUT);
+	kernel3.setArg(3, buffer_change);
+	kernel3.setArg(4, cl::Local(local_elements_lut * sizeof(float))); // local memory size for a local histogram
+	kernel3.setArg(5, cl::Local(local_elements_lut * sizeof(float))); // local memory size for a cumulative histogram
+	kernel3.setArg(6, threshold_elements);
+	kernel3.setArg(7, bin_count);
+	kernel3.setArg(8, (standard)image_elements);
+
+	kernel4.setArg(1, buffer_LUT);
+	kernel4.setArg(2, buffer_output_image);
+
+	int frame_count = 0, lut_count = 0;
+	cl_ulong total_kernel_time = 0;
+	auto start_time = std::chrono::high_resolution_clock::now();
+
+	input_images[0].load(get_frame_path(pattern, 1).c_str());
+	upload_queue.enqueueWriteBuffer(buffer_input_image[0], CL_FALSE, 0, image_size, input_images[0].data(), NULL, &upload_events[0]);
+	upload_queue.flush(); // nothing waits on the upload queue itself, so submit the upload now instead of leaving it to the runtime
+
+	for (int frame = 1; ; frame++)
+	{
+		int slot = (frame - 1) % 2;
+		cl::Event kernel1_event, kernel2_event, kernel3_event, kernel4_event;
+		std::vector<cl::Event> upload_wait_list = { upload_events[slot] };
+		standard change;
+
+		// Step 0: reset the histogram and its change
+		queue.enqueueFillBuffer(buffer_H, 0, 0, bin_count * sizeof(standard), &upload_wait_list);
+		queue.enqueueFillBuffer(buffer_change, 0, 0, sizeof(standard));
+
+		kernel1.setArg(0, buffer_input_image[slot]);
+		kernel2.setArg(4, frame == 1 ? 1.0f : alpha);
+		kernel4.setArg(0, buffer_input_image[slot]);
+
+		if (sizeof(T) == 1)
+			queue.enqueueNDRangeKernel(kernel1, cl::NullRange, cl::NDRange(global_elements_8), cl::NDRange(local_elements_8), NULL, &kernel1_event);
+		else
+			queue.enqueueNDRangeKernel(kernel1, cl::NullRange, cl::NDRange(image_elements), cl::NullRange, NULL, &kernel1_event);
+
+		queue.enqueueNDRangeKernel(kernel2, cl::NullRange, cl::NDRange(bin_count), cl::NullRange, NULL, &kernel2_event);
+		queue.enqueueNDRangeKernel(kernel3, cl::NullRange, cl::NDRange(local_elements_lut), cl::NDRange(local_elements_lut), NULL, &kernel3_event); // a single work group
+		queue.enqueueNDRangeKernel(kernel4, cl::NullRange, cl::NDRange(image_elements), cl::NullRange, NULL, &kernel4_event);
+		queue.enqueueReadBuffer(buffer_change, CL_FALSE, 0, sizeof(standard), &change);
+
+		output_images[slot].assign(width, height, 1, spectrum);
+		queue.enqueueReadBuffer(buffer_output_image, CL_FALSE, 0, image_size, output_images[slot].data(), NULL, &output_events[slot]);
+		queue.flush(); // submit the frame, so that the device works on it while the host loads the next frame
+
+		// load and upload the next frame while the current one is processed (the other slot is free as the previous frame has finished)
+		string next_path = get_frame_path(pattern, frame + 1);
+		bool has_next = std::ifstream(next_path.c_str()).good();
+
+		if (has_next)
+		{
+			input_images[1 - slot].load(next_path.c_str());
+
+			if (input_images[1 - slot].width() != width || input_images[1 - slot].height() != height || input_images[1 - slot].spectrum() != spectrum)
+			{
+				std::cout << "Program - ERROR: Frame " << frame + 1 << " has a different size from frame 1." << std::endl;
+				has_next = false;
+			}
+			else
+			{
+				upload_queue.enqueueWriteBuffer(buffer_input_image[1 - slot], CL_FALSE, 0, image_size, input_images[1 - slot].data(), NULL, &upload_events[1 - slot]);
+				upload_queue.flush(); // submit the upload, so that it overlaps with the current frame instead of starting when the next frame waits for it
+			} // end if...else
+		} // end if
+
+		output_events[slot].wait();
+		output_images[slot].save(get_frame_output_path(pattern, frame).c_str());
+
+		frame_count++;
+		lut_count += change > threshold_elements;
+		total_kernel_time += get_event_time(kernel1_event) + get_event_time(kernel2_event) + get_event_time(kernel3_event) + get_event_time(kernel4_event);
+
+		if (!has_next)
+			break;
+	} // end for
+
+	auto end_time = std::chrono::high_resolution_clock::now();
+	double seconds = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count() / 1e6;
+
+	std::cout << frame_count << " frame(s) equalised, LUT updated for " << lut_count << " frame(s)" << std::endl;
+	std::cout << "Kernel execution time per frame: " << total_kernel_time / frame_count / 1000 << " us" << std::endl;
+	std::cout << "Program execution time (wall clock, including file I/O): " << (long long)(seconds * 1e6) << " us (" << frame_count / seconds << " fps)" << std::endl;
+} // end function run_video
+
+/*
+equalise image data in a named shared-memory object in place (daemon mode);
+the object holds "width * height * spectrum" planar elements of 8 or 16 bits without a header, and an object smaller than that is rejected
+*/
+cl_ulong equalise_shared_memory(Equaliser& equaliser, const string& name, int width, int height, int spectrum, int bits)
+{
+	size_t image_size = (size_t)width * height * spectrum * (bits == 8 ? sizeof(unsigned char) : sizeof(unsigned short));
+	cl_ulong kernel_time;
+
+#ifdef _WIN32
+	HANDLE mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name.c_str());
+
+	if (!mapping)
+		throw std::runtime_error("cannot open shared memory " + name);
+
+	void* data = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0); // map the whole object, so that its size can be queried
+	MEMORY_BASIC_INFORMATION info;
+
+	if (!data)
+	{
+		CloseHandle(mapping);
+		throw std::runtime_error("cannot map shared memory " + name);
+	} // end if
+
+	// the view is as large as the object rounded up to a page, so a smaller view cannot hold the image
+	if (!VirtualQuery(data, &info, sizeof(info)) || info.RegionSize < image_size)
+	{
+		UnmapViewOfFile(data);
+		CloseHandle(mapping);
+		throw std::runtime_error("shared memory " + name + " is smaller than the image");
+	} // end if
+
+	try
+	{
+		kernel_time = equaliser.EqualiseAsync(data, data, width, height, spectrum, bits).get();
+	}
+	catch (...)
+	{
+		UnmapViewOfFile(data);
+		CloseHandle(mapping);
+		throw;
+	} // end try...catch
+
+	UnmapViewOfFile(data);
+	CloseHandle(mapping);
+#else
+	int descriptor = shm_open(name.c_str(), O_RDWR, 0);
+
+	if (descriptor < 0)
+		throw std::runtime_error("cannot open shared memory " + name);
+
+	struct stat info;
+
+	// accessing a mapping beyond the end of the object raises "SIGBUS", so a smaller object is rejected before it is mapped
+	if (fstat(descriptor, &info) < 0 || (size_t)info.st_size < image_size)
+	{
+		close(descriptor);
+		throw std::runtime_error("shared memory " + name + " is smaller than the image");
+	} // end if
+
+	void* data = mmap(NULL, image_size, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+
+	close(descriptor);
+
+	if (data == MAP_FAILED)
+		throw std::runtime_error("cannot map shared memory " + name);
+
+	try
+	{
+		kernel_time = equaliser.EqualiseAsync(data, data, width, height, spectrum, bits).get();
+	}
+	catch (...)
+	{
+		munmap(data, image_size);
+		throw;
+	} // end try...catch
+
+	munmap(data, image_size);
+#endif
+
+	return kernel_time;
+} // end function equalise_shared_memory
+
+/*
+check the embeddable equaliser on synthetic 8-bit planar images of 1, 3, and 4 channels (check mode);
+each output is compared with an LUT computed on the host from a histogram averaged over the channels, the same arithmetic as kernel "get_sparse_lut";
+return true if all outputs match
+*/
+bool check_equaliser(Equaliser& equaliser)
+{
+	const int width = 64, height = 4, channel_counts[] = { 1, 3, 4 };
+	int pixel_count = width * height;
+	bool passed = true;
+
+	for (int channels : channel_counts)
+	{
+		std::vector<unsigned char> input(pixel_count * channels), output(input.size());
+		std::vector<cl_ulong> CH(256, 0);
+
+		// give each channel a different distribution so that averaging the channels matters
+		for (int channel = 0; channel < channels; channel++)
+			for (int i = 0; i < pixel_count; i++)
+				input[channel * pixel_count + i] = (unsigned char)((i * 7 + channel * 31) % 256 / (channel + 1));
+
+		for (unsigned char value : input)
+			CH[value]++;
+
+		for (int i = 1; i < 256; i++)
+			CH[i] += CH[i - 1];
+
+		equaliser.EqualiseAsync(&input[0], &output[0], width, height, channels, 8).get();
+
+		int mismatches = 0;
+
+		for (size_t i = 0; i < input.size(); i++)
+			mismatches += output[i] != (unsigned char)(CH[input[i]] / channels * 255 / pixel_count);
+
+		std::cout << "Equaliser check (" << channels << " channel(s)): " << (mismatches ? "FAILED, " + std::to_string(mismatches) + " element(s) differ" : "passed") << std::endl;
+		passed = passed && !mismatches;
+	} // end for
+
+	return passed;
+} // end function check_equaliser
+
+/*
+handle a request line of daemon mode and get its response line;
+"file <input path> <output path>" equalises an image file (8-bit/16-bit) and saves the result,
+"shm <name> <width> <height> <spectrum> <bits>" equalises image data in a shared-memory object in place, and "quit" stops the daemon;
+the response is "OK <kernel execution time in microseconds>" or "ERROR <message>"
+*/
+string handle_request(Equaliser& equaliser, const string& request, bool& quit)
+{
+	std::istringstream fields(request);
+	string command;
+
+	fields >> command;
+
+	try
+	{
+		if (command == "quit")
+		{
+			quit = true;
+
+			return "OK 0";
+		}
+		else if (command == "file")
+		{
+			string input_path, output_path;
+
+			if (!(fields >> input_path >> output_path))
+				return "ERROR usage: file <input path> <output path>";
+
+			CImg<unsigned short> image(input_path.c_str());
+			cl_ulong kernel_time;
+
+			if (image.max() <= 255)
+			{
+				CImg<unsigned char> image_8(image);
+
+				kernel_time = equaliser.EqualiseAsync(image_8.data(), image_8.data(), image_8.width(), image_8.height(), image_8.size() / image_8.width() / image_8.height(), 8).get();
+				image_8.save(output_path.c_str());
+			}
+			else
+			{
+				kernel_time = equaliser.EqualiseAsync(image.data(), image.data(), image.width(), image.height(), image.size() / image.width() / image.height(), 16).get();
+				image.save(output_path.c_str());
+			} // end if...else
+
+			return "OK " + std::to_string(kernel_time / 1000);
+		}
+		else if (command == "shm")
+		{
+			string name;
+			int width, height, spectrum, bits;
+
+			if (!(fields >> name >> width >> height >> spectrum >> bits) || width <= 0 || height <= 0 || spectrum <= 0 || (bits != 8 && bits != 16))
+				return "ERROR usage: shm <name> <width> <height> <spectrum> <bits (8/16)>";
+
+			return "OK " + std::to_string(equalise_shared_memory(equaliser, name, width, height, spectrum, bits) / 1000);
+		}
+		else
+			return "ERROR unknown command " + command;
+	}
+	catch (const cl::Error& e)
+	{
+		return "ERROR OpenCL " + string(e.what()) + ", " + getErrorString(e.err());
+	}
+	catch (CImgException& e)
+	{
+		return "ERROR CImg " + string(e.what());
+	}
+	catch (const std::exception& e)
+	{
+		return "ERROR " + string(e.what());
+	} // end try...catch
+} // end function handle_request
+
+/*
+serve the request lines of a connection until it is closed or a "quit" request arrives (daemon mode);
+"read" and "write" wrap the I/O functions of the platform and return the number of bytes read or written (0 or less when the connection is closed or fails);
+a response is written in a loop until all of it is sent, and the connection is given up if a write fails (e.g. the client has gone without reading its reply)
+*/
+template <typename Read, typename Write>
+bool serve_connection(Equaliser& equaliser, Read read, Write write)
+{
+	string pending;
+	char chunk[4096];
+	bool quit = false;
+	int length;
+
+	while (!quit && (length = read(chunk, sizeof(chunk))) > 0)
+	{
+		size_t line_end;
+
+		pending.append(chunk, length);
+
+		while (!quit && (line_end = pending.find('\n')) != string::npos)
+		{
+			string request = pending.substr(0, line_end);
+
+			pending.erase(0, line_end + 1);
+
+			if (!request.empty() && request.back() == '\r')
+				request.pop_back();
+
+			if (!request.empty())
+			{
+				string response = handle_request(equaliser, request, quit) + "\n";
+				size_t sent = 0;
+
+				while (sent < response.size())
+				{
+					int written = write(response.c_str() + sent, (int)(response.size() - sent));
+
+					if (written <= 0)
+						return quit;
+
+					sent += written;
+				} // end while
+			} // end if
+		} // end while
+	} // end while
+
+	return quit;
+} // end function serve_connection
+
+/*
+initialise OpenCL once and serve equalisation jobs until a "quit" request arrives (daemon mode);
+the endpoint is a Unix domain socket path, or a named pipe name (e.g. "\\.\pipe\equalise") on Windows, and each connection may send any number of request lines
+*/
+void run_daemon(const cl::Context& context, const cl::Program& program, const string& endpoint)
+{
+	Equaliser equaliser(context, context.getInfo<CL_CONTEXT_DEVICES>()[0], program); // the context of daemon mode holds the selected device only
+	bool quit = false;
+
+#ifdef _WIN32
+	while (!quit)
+	{
+		HANDLE pipe = CreateNamedPipeA(endpoint.c_str(), PIPE_ACCESS_DUPLEX, PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT, 1, 4096, 4096, 0, NULL);
+
+		if (pipe == INVALID_HANDLE_VALUE)
+			throw std::runtime_error("cannot create named pipe " + endpoint);
+
+		if (ConnectNamedPipe(pipe, NULL) || GetLastError() == ERROR_PIPE_CONNECTED)
+			quit = serve_connection(equaliser,
+				[pipe](char* buffer, int size) { DWORD length = 0; return ReadFile(pipe, buffer, size, &length, NULL) ? (int)length : -1; },
+				[pipe](const char* buffer, int size) { DWORD length = 0; return WriteFile(pipe, buffer, size, &length, NULL) ? (int)length : -1; });
+
+		DisconnectNamedPipe(pipe);
+		CloseHandle(pipe);
+	} // end while
+#else
+	signal(SIGPIPE, SIG_IGN); // a client closing its connection before reading its reply must not kill the daemon (the failed write ends the connection)
+
+	int server = socket(AF_UNIX, SOCK_STREAM, 0);
+	sockaddr_un address = {};
+
+	if (server < 0 || endpoint.size() >= sizeof(address.sun_path))
+		throw std::runtime_error("cannot create Unix domain socket " + endpoint);
+
+	address.sun_family = AF_UNIX;
+	endpoint.copy(address.sun_path, endpoint.size());
+	unlink(endpoint.c_str()); // remove a socket file left by a previous daemon
+
+	if (bind(server, (sockaddr*)&address, sizeof(address)) < 0 || listen(server, 8) < 0)
+	{
+		close(server);
+		throw std::runtime_error("cannot listen on Unix domain socket " + endpoint);
+	} // end if
+
+	while (!quit)
+	{
+		int client = accept(server, NULL, NULL);
+
+		if (client < 0)
+			continue;
+
+		quit = serve_connection(equaliser,
+			[client](char* buffer, int size) { return (int)recv(client, buffer, size, 0); },
+			[client](const char* buffer, int size) { return (int)send(client, buffer, size, MSG_NOSIGNAL); });
+
+		close(client);
+	} // end while
+
+	close(server);
+	unlink(endpoint.c_str());
+#endif
+} // end function run_daemon
+
 /*
 Please note that this is NOT the summary required. Please refer to "Summary of Code.pdf" for the summary. The main content contains 266 words,
 and it is strongly recommended to read it before running the program.
@@ -25,6 +843,17 @@ int main(int argc, char **argv)
 	int platform_id = 0;
 	int device_id = 0;
 	int mode_id = 0;
+	bool multi_device = false; // split the image across all devices of all platforms instead of using the selected device
+	bool numa = false; // split the image across the NUMA sub-devices of the selected device
+	bool stats = false; // compute image statistics in the same read as the histogram and choose the bit depth from the maximum read back from the device
+	bool adaptive_bins = false; // size the histogram, cumulative histogram, and LUT of a 16-bit image to its actual value range instead of 65536 bins
+	bool sparse = false; // scan and write the LUT entries of the occupied bins of a 16-bit image only
+	string video_pattern; // a pattern of numbered frames with a single "%d" or "%0Nd" token for video mode
+	string daemon_endpoint; // a Unix domain socket path or a named pipe name for daemon mode
+	bool check = false; // check the embeddable equaliser on synthetic images of several channel counts instead of equalising an image
+	bool in_place = false; // write the output image over the input image buffer and the LUT over the histogram buffer on the device
+	bool debug = false; // allocate host vectors for the intermediate results and print them
+	bool fold_fills = false; // let the kernels initialise their own outputs instead of zeroing buffers before the kernels
 	string image_filename = "test.ppm";
 
 	for (int i = 1; i < argc; i++)
@@ -33,14 +862,17 @@ int main(int argc, char **argv)
 		if (strcmp(argv[i], "-l") == 0)
 		{
 			std::cout << ListPlatformsDevices();
-			std::cout << "3 run modes:" << std::endl;
+			std::cout << "4 run modes:" << std::endl;
 			std::cout << "   Mode 0, Fast Mode 1 (default)" << std::endl;
 			std::cout << "      Compared to Basic Mode, program can consume less kernel execution time.\n" << std::endl;
 			std::cout << "   Mode 1, Fast Mode 2" << std::endl;
 			std::cout << "      Compared to Fast Mode 1, program may consume even less kernel execution time because of a different helper ";
 			std::cout << "kernel. This mode only takes effect on a 16-bit iamge and is the same as Fast Mode 1 on an 8-bit image.\n" << std::endl;
 			std::cout << "   Mode 2, Basic Mode" << std::endl;
-			std::cout << "      This mode has brilliant compatibility but may significantly consume more kernel execution time." << std::endl;
+			std::cout << "      This mode has brilliant compatibility but may significantly consume more kernel execution time.\n" << std::endl;
+			std::cout << "   Mode 3, Auto-levels Mode" << std::endl;
+			std::cout << "      Instead of histogram equalisation, program applies a linear contrast stretch between the 0.5th and 99.5th percentiles ";
+			std::cout << "found in the cumulative histogram. The histogram and cumulative histogram kernels are the same as Fast Mode 1." << std::endl;
 			std::cout << "----------------------------------------------------------------" << std::endl;
 		}
 		else if ((strcmp(argv[i], "-p") == 0) && (i < (argc - 1)))
@@ -51,6 +883,28 @@ int main(int argc, char **argv)
 			mode_id = atoi(argv[++i]);
 		else if ((strcmp(argv[i], "-f") == 0) && (i < (argc - 1)))
 			image_filename = argv[++i];
+		else if (strcmp(argv[i], "-a") == 0)
+			multi_device = true;
+		else if (strcmp(argv[i], "-n") == 0)
+			numa = true;
+		else if (strcmp(argv[i], "-s") == 0)
+			stats = true;
+		else if (strcmp(argv[i], "-b") == 0)
+			adaptive_bins = true;
+		else if (strcmp(argv[i], "-c") == 0)
+			sparse = true;
+		else if ((strcmp(argv[i], "-v") == 0) && (i < (argc - 1)))
+			video_pattern = argv[++i];
+		else if ((strcmp(argv[i], "-w") == 0) && (i < (argc - 1)))
+			daemon_endpoint = argv[++i];
+		else if (strcmp(argv[i], "-k") == 0)
+			check = true;
+		else if (strcmp(argv[i], "-i") == 0)
+			in_place = true;
+		else if (strcmp(argv[i], "-g") == 0)
+			debug = true;
+		else if (strcmp(argv[i], "-z") == 0)
+			fold_fills = true;
 		else if (strcmp(argv[i], "-h") == 0)
 		{
 			// print help info to the console
@@ -60,6 +914,27 @@ int main(int argc, char **argv)
 			std::cerr << "  -p : select platform" << std::endl;
 			std::cerr << "  -d : select device" << std::endl;
 			std::cerr << "  -m : select run mode" << std::endl;
+			std::cerr << "  -a : split the image rows across all devices of all platforms (multi-device mode, options \"-p\", \"-d\", and \"-m\" are ignored)" << std::endl;
+			std::cerr << "       (Auto-levels Mode is not supported and \"-m 3\" is rejected)" << std::endl;
+			std::cerr << "  -n : partition the selected CPU device by NUMA node and split the image rows across the sub-devices (NUMA mode, option \"-m\" is ignored)" << std::endl;
+			std::cerr << "       (Auto-levels Mode is not supported and \"-m 3\" is rejected)" << std::endl;
+			std::cerr << "  -s : compute image statistics (min, max, mean, variance, percentiles) in the same read as the histogram and choose bit depth from them" << std::endl;
+			std::cerr << "       (ignored in multi-device mode and NUMA mode)" << std::endl;
+			std::cerr << "  -b : size the bins of a 16-bit image to its actual bit depth (e.g. 4096 bins for 12-bit data) instead of 65536 bins" << std::endl;
+			std::cerr << "  -c : compact the occupied bins of a 16-bit image and only scan them and write their LUT entries (sparse cumulative histogram)" << std::endl;
+			std::cerr << "       (ignored in Basic Mode, Auto-levels Mode, statistics mode, multi-device mode, and NUMA mode)" << std::endl;
+			std::cerr << "  -v : equalise numbered frames (from 1) specified by a pattern with a single \"%d\" or \"%0Nd\" token, e.g. \"frame_%04d.ppm\", with a histogram smoothed across frames (video mode)" << std::endl;
+			std::cerr << "       (options \"-m\", \"-a\", \"-n\", \"-s\", \"-b\", \"-c\", and \"-f\" are ignored; the outputs are saved as \"images/equalised_<frame file name>\")" << std::endl;
+			std::cerr << "  -w : initialise OpenCL once and serve equalisation jobs over the specified Unix domain socket path or named pipe name (daemon mode)" << std::endl;
+			std::cerr << "       requests are lines \"file <input path> <output path>\", \"shm <name> <width> <height> <spectrum> <bits>\", or \"quit\"" << std::endl;
+			std::cerr << "       (all other options except \"-p\" and \"-d\" are ignored)" << std::endl;
+			std::cerr << "  -k : check the embeddable equaliser of daemon mode on synthetic 8-bit images of 1, 3, and 4 channels and exit (check mode)" << std::endl;
+			std::cerr << "       (all other options except \"-p\" and \"-d\" are ignored)" << std::endl;
+			std::cerr << "  -i : write the output image over the input image and the LUT over the histogram on the device to roughly halve device memory (in-place mode)" << std::endl;
+			std::cerr << "       (ignored for an 8-bit image in statistics mode, and in multi-device mode and NUMA mode)" << std::endl;
+			std::cerr << "  -g : print the histogram, cumulative histogram, block sums, and LUT (debug mode)" << std::endl;
+			std::cerr << "  -z : use cumulative histogram, block sum, and LUT kernels writing every element instead of zeroing their buffers before the kernels (folded fills)" << std::endl;
+			std::cerr << "       (the histogram and the bitmap of option \"-c\" are still zeroed; ignored in multi-device mode and NUMA mode)" << std::endl;
 			std::cerr << "  -f : specify input image file" << std::endl;
 			std::cerr << "       ATTENTION: 1. \"test.ppm\" is default" << std::endl;
 			std::cerr << "                  2. Please select a PPM image file (8-bit/16-bit RGB)" << std::endl;
@@ -70,26 +945,101 @@ int main(int argc, char **argv)
 	} // end for
 
 	// check if the run mode ID is valid
-	if (mode_id != 0 && mode_id != 1 && mode_id != 2)
+	if (mode_id != 0 && mode_id != 1 && mode_id != 2 && mode_id != 3)
 	{
 		std::cout << "Program - ERROR: Inexistent run mode ID." << std::endl;
 		return 0;
 	} // end if
 
-	string image_path = "images/" + image_filename;
+	// check if the frame pattern is valid before any frame path is built from it
+	size_t token_start, token_end;
+	int token_width;
+
+	if (!video_pattern.empty() && !find_frame_token(video_pattern, token_start, token_end, token_width))
+	{
+		std::cout << "Program - ERROR: Invalid frame pattern (a single \"%d\" or \"%0Nd\" is expected)." << std::endl;
+		return 0;
+	} // end if
+
+	/*
+	Auto-levels Mode shares the histogram and cumulative histogram kernels of Fast Mode 1,
+	so it is recorded separately and the run mode ID is switched to that of Fast Mode 1
+	*/
+	bool auto_levels = mode_id == 3;
+
+	if (auto_levels)
+		mode_id = 0;
+
+	// the multi-device mode and NUMA mode only implement histogram equalisation, so Auto-levels Mode is rejected there instead of being silently replaced
+	if (auto_levels && (multi_device || numa) && video_pattern.empty() && daemon_endpoint.empty())
+	{
+		std::cout << "Program - ERROR: Auto-levels Mode is not supported in multi-device mode and NUMA mode." << std::endl;
+		return 0;
+	} // end if
+
+	// the multi-device mode and NUMA mode choose the bit depth on the host before splitting the image
+	if (multi_device || numa)
+		stats = false;
+
+	string image_path = video_pattern.empty() ? "images/" + image_filename : get_frame_path(video_pattern, 1);
 
 	cimg::exception_mode(0);
 
 	// detect any potential exceptions
 	try
 	{
+		// run in check mode if specified, which needs no input image
+		if (check)
+		{
+			cl::Context context = GetContext(platform_id, device_id);
+			Equaliser equaliser(context, context.getInfo<CL_CONTEXT_DEVICES>()[0], build_program(context));
+
+			std::cout << "Running in Check Mode on " << GetPlatformName(platform_id) << ", " << GetDeviceName(platform_id, device_id) << std::endl;
+
+			return check_equaliser(equaliser) ? 0 : 1;
+		} // end if
+
+		// run in daemon mode if specified, which needs no input image
+		if (!daemon_endpoint.empty())
+		{
+			cl::Context context = GetContext(platform_id, device_id);
+
+			std::cout << "Running in Daemon Mode on " << GetPlatformName(platform_id) << ", " << GetDeviceName(platform_id, device_id) << ", listening on " << daemon_endpoint << std::endl;
+
+			run_daemon(context, build_program(context), daemon_endpoint);
+
+			return 0;
+		} // end if
+
 		// Part 2 - image info loading
 		CImg<unsigned short> input_image(image_path.c_str()); // read data from an RGB image file (8-bit/16-bit)
+
+		// run in video mode if specified, choosing the bit depth with the first frame
+		if (!video_pattern.empty())
+		{
+			cl::Context context = GetContext(platform_id, device_id);
+			cl::Program program = build_program(context);
+
+			std::cout << "Running in Video Mode on " << GetPlatformName(platform_id) << ", " << GetDeviceName(platform_id, device_id) << std::endl;
+
+			if (input_image.max() <= 255)
+				run_video<unsigned char>(context, program, video_pattern, input_image.width(), input_image.height(), input_image.spectrum(), 256);
+			else
+				run_video<unsigned short>(context, program, video_pattern, input_image.width(), input_image.height(), input_image.spectrum(), 65536);
+
+			return 0;
+		} // end if
+
 		CImg<unsigned char> input_image_8; // "unsigned char" is sufficient for data from an 8-bit image if any
 		size_t input_image_elements = input_image.size(); // number of elements
 		size_t input_image_size = input_image_elements * sizeof(unsigned short); // size in bytes
 		int input_image_width = input_image.width(), input_image_height = input_image.height();
-		int bin_count = input_image.max() <= 255 ? 256 : 65536; // bin numbers of an image (8-bit: 256, 16-bit: 65536)
+		/*
+		bin numbers of an image (8-bit: 256, 16-bit: 65536, or the smallest power of 2 above the maximum value with adaptive bins);
+		in statistics mode, the maximum is found by the fused statistics kernel instead of scanning the image on the host here,
+		and the bin number is chosen on the host after a blocking read of the 4 statistics reduced on the device, which stalls the queue between the statistics kernels and the rest of the pipeline
+		*/
+		int bin_count = stats ? 65536 : (input_image.max() <= 255 ? 256 : (adaptive_bins ? get_adaptive_bin_count(input_image.max()) : 65536));
 		float scale = 1.0f; // the scale for displaying an image
 		
 		// set the scale for resizing when the image expands the standard
@@ -120,47 +1070,138 @@ int main(int argc, char **argv)
 			display the input 16-bit image;
 			resize to provide a better view when necessary (this does not modify the input image data for processing)
 			*/
-			input_image_display.assign(CImg<unsigned short>(input_image).resize((int)(input_image_width * scale), (int)(input_image_height * scale)), "Input image (16-bit)");
+			input_image_display.assign(CImg<unsigned short>(input_image).resize((int)(input_image_width * scale), (int)(input_image_height * scale)), stats ? "Input image" : "Input image (16-bit)");
 		
+		if (adaptive_bins && !stats && bin_count > 256)
+			std::cout << "Using " << bin_count << " bins for the actual value range of the image\n" << std::endl;
+
+		// run in multi-device mode or NUMA mode if specified
+		if (multi_device || numa)
+		{
+			CImgDisplay output_image_display;
+			size_t row_count = (size_t)input_image_height * input_image.depth() * input_image.spectrum(); // rows of all colour channels are stacked
+			std::vector<cl::Device> devices;
+
+			if (multi_device)
+			{
+				devices = GetAllDevices();
+
+				std::cout << "Running in Multi-device Mode on " << devices.size() << " device(s)" << std::endl;
+			}
+			else
+			{
+				devices = GetNUMASubDevices(platform_id, device_id);
+
+				std::cout << "Running in NUMA Mode on " << devices.size() << " sub-device(s) of " << GetPlatformName(platform_id) << ", " << GetDeviceName(platform_id, device_id) << std::endl;
+			} // end if...else
+
+			if (bin_count == 256)
+			{
+				CImg<unsigned char> output_image_8(input_image_width, input_image_height, input_image.depth(), input_image.spectrum());
+
+				equalise_multi_device(devices, input_image_8.data(), output_image_8.data(), input_image_width, row_count, bin_count, input_image_width * input_image_height, numa && !multi_device);
+				output_image_display.assign(output_image_8.resize((int)(input_image_width * scale), (int)(input_image_height * scale)), "Output image (8-bit)");
+			}
+			else
+			{
+				CImg<unsigned short> output_image_16(input_image_width, input_image_height, input_image.depth(), input_image.spectrum());
+
+				equalise_multi_device(devices, input_image.data(), output_image_16.data(), input_image_width, row_count, bin_count, input_image_width * input_image_height, numa && !multi_device);
+				output_image_display.assign(output_image_16.resize((int)(input_image_width * scale), (int)(input_image_height * scale)), "Output image (16-bit)");
+			} // end if...else
+
+			while (!input_image_display.is_closed() && !output_image_display.is_closed()
+				&& !input_image_display.is_keyESC() && !output_image_display.is_keyESC())
+			{
+				input_image_display.wait(1);
+				output_image_display.wait(1);
+			} // end while
+
+			return 0;
+		} // end if
+
 		// Part 3 - host operations
 		// 3.1 Select computing devices
 		cl::Context context = GetContext(platform_id, device_id);
 
-		std::cout << "Running in " << (mode_id == 0 ? "Fast Mode 1" : (mode_id == 1 ? "Fast Mode 2" : "Basic Mode")) << " on " << GetPlatformName(platform_id) << ", " << GetDeviceName(platform_id, device_id) << std::endl; // display the selected device
+		std::cout << "Running in " << (auto_levels ? "Auto-levels Mode" : (mode_id == 0 ? "Fast Mode 1" : (mode_id == 1 ? "Fast Mode 2" : "Basic Mode"))) << " on " << GetPlatformName(platform_id) << ", " << GetDeviceName(platform_id, device_id) << std::endl; // display the selected device
 
 		cl::CommandQueue queue(context, CL_QUEUE_PROFILING_ENABLE); // create a queue to which we will push commands for the device and enable profiling for the queue
 
 		// 3.2 Load & build the device code
-		cl::Program::Sources sources;
+		cl::Program program = build_program(context);
 
-		AddSources(sources, "kernels/assessment1_kernels.cl");
+		// 3.3 Get a histogram and statistics of the image in a single read, reduce the statistics on the device, and choose the bit depth on the host from the 4 values read back (statistics mode)
+		cl::Buffer buffer_input_image, buffer_H; // input image buffer and histogram buffer
+		cl::Event input_image_event, H_input_event, kernel1_event, stats_reduce_event; // add additional events to measure the upload time of input vectors and the histogram kernel execution time
 
-		cl::Program program(context, sources);
-
-		// build and debug the kernel code
-		try
-		{ 
-			program.build();
-		}
-		catch (const cl::Error& err)
+		if (stats)
 		{
-			std::cout << "Build Status: " << program.getBuildInfo<CL_PROGRAM_BUILD_STATUS>(context.getInfo<CL_CONTEXT_DEVICES>()[0]) << std::endl;
-			std::cout << "Build Options:\t" << program.getBuildInfo<CL_PROGRAM_BUILD_OPTIONS>(context.getInfo<CL_CONTEXT_DEVICES>()[0]) << std::endl;
-			std::cout << "Build Log:\t " << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(context.getInfo<CL_CONTEXT_DEVICES>()[0]) << std::endl;
-			throw err;
-		} // end try...catch
+			cl::Kernel kernel_stats(program, "get_H_stats");
+			size_t local_elements_stats = 1;
+			size_t max_local_elements_stats = kernel_stats.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(context.getInfo<CL_CONTEXT_DEVICES>()[0]);
 
-		// Part 4 - memory allocation
-		typedef unsigned int standard; // use "unsigned int" as the standard data type to avoid integer overflow when processing some large images
+			// the reduction in the kernel requires the number of local elements to be a power of 2
+			while (local_elements_stats * 2 <= max_local_elements_stats && local_elements_stats < 256)
+				local_elements_stats *= 2;
+
+			size_t stats_group_count = (input_image_elements + local_elements_stats - 1) / local_elements_stats;
+			cl_ulong image_stats[4]; // minimum, maximum, sum, and sum of squares of the image
+
+			buffer_input_image = cl::Buffer(context, in_place ? CL_MEM_READ_WRITE : CL_MEM_READ_ONLY, input_image_size);
+			buffer_H = cl::Buffer(context, CL_MEM_READ_WRITE, 65536 * sizeof(standard)); // 8-bit images only occupy the first 256 bins
 
-		std::vector<standard> H(bin_count, 0); // vector H for a histogram
-		size_t H_elements = H.size(); // number of elements
+			cl::Buffer buffer_group_stats(context, CL_MEM_READ_WRITE, 4 * stats_group_count * sizeof(cl_ulong)); // statistics of each work group
+			cl::Buffer buffer_stats(context, CL_MEM_WRITE_ONLY, sizeof(image_stats));
+
+			queue.enqueueWriteBuffer(buffer_input_image, CL_FALSE, 0, input_image_size, &input_image.data()[0], NULL, &input_image_event);
+			queue.enqueueFillBuffer(buffer_H, 0, 0, 65536 * sizeof(standard), NULL, &H_input_event); // zero histogram buffer on device memory
+
+			kernel_stats.setArg(0, buffer_input_image);
+			kernel_stats.setArg(1, buffer_H);
+			kernel_stats.setArg(2, buffer_group_stats);
+			kernel_stats.setArg(3, cl::Local(4 * local_elements_stats * sizeof(cl_ulong))); // local memory size for the 4 statistics of each work item
+			kernel_stats.setArg(4, (standard)input_image_elements);
+
+			queue.enqueueNDRangeKernel(kernel_stats, cl::NullRange, cl::NDRange(stats_group_count * local_elements_stats), cl::NDRange(local_elements_stats), NULL, &kernel1_event);
+
+			// reduce the statistics of the work groups on the device with a single work group of the same size
+			cl::Kernel kernel_reduce_stats(program, "reduce_stats");
+
+			kernel_reduce_stats.setArg(0, buffer_group_stats);
+			kernel_reduce_stats.setArg(1, buffer_stats);
+			kernel_reduce_stats.setArg(2, cl::Local(4 * local_elements_stats * sizeof(cl_ulong)));
+			kernel_reduce_stats.setArg(3, (standard)stats_group_count);
+
+			queue.enqueueNDRangeKernel(kernel_reduce_stats, cl::NullRange, cl::NDRange(local_elements_stats), cl::NDRange(local_elements_stats), NULL, &stats_reduce_event);
+
+			// the bin number decides the sizes of the buffers and the kernels to build, so this read of 4 values must block before the rest of the pipeline is enqueued
+			queue.enqueueReadBuffer(buffer_stats, CL_TRUE, 0, sizeof(image_stats), image_stats);
+
+			cl_ulong image_min = image_stats[0], image_max = image_stats[1], image_sum = image_stats[2], image_sumsq = image_stats[3];
+
+			double mean = (double)image_sum / input_image_elements;
+			double variance = (double)image_sumsq / input_image_elements - mean * mean;
+
+			bin_count = image_max <= 255 ? 256 : (adaptive_bins ? get_adaptive_bin_count((int)image_max) : 65536); // choose the bit depth with the observed maximum
+
+			std::cout << "Image statistics (" << (bin_count == 256 ? "8-bit" : (bin_count == 65536 ? "16-bit" : std::to_string(bin_count) + " bins")) << "): min " << image_min << ", max " << image_max;
+			std::cout << ", mean " << mean << ", variance " << variance << ", standard deviation " << sqrt(variance) << std::endl;
+		} // end if
+
+		// Part 4 - memory allocation
+		size_t H_elements = bin_count; // number of elements in vector H for a histogram
 		size_t H_size = H_elements * sizeof(standard); // size in bytes
 
-		std::vector<standard> CH(H_elements, 0); // vector CH for a cumulative histogram
-		size_t CH_elements = CH.size(); // number of elements
+		size_t CH_elements = H_elements; // number of elements in vector CH for a cumulative histogram
 		size_t CH_size = CH_elements * sizeof(standard); // size in bytes
 
+		/*
+		an 8-bit output written over a 16-bit input (statistics mode) would overwrite input elements not read yet,
+		so in-place mode only applies when the input and output elements have the same size
+		*/
+		in_place = in_place && !(stats && bin_count == 256);
+
 		/*
 		number of local elements when processing an 8-bit image;
 		this is equal to the number of bins of an 8-bit image so as to use 1 work group for a kernel since it is not a large problem;
@@ -180,16 +1221,47 @@ int main(int argc, char **argv)
 		if (kernel1_global_elements_8_padding)
 			kernel1_global_elements_8 += (local_elements_8 - kernel1_global_elements_8_padding);
 
+		/*
+		with adaptive bins, the histogram of a 16-bit image may fit in local memory (e.g. 16 KB for 12-bit data) next to the local memory the kernel itself needs,
+		so the local memory histogram kernel can be used with the same local elements as for an 8-bit image;
+		each of its work groups zeroes and flushes all bins, so only a few work groups per compute unit are launched and loop over the image
+		*/
+		cl::Device device = context.getInfo<CL_CONTEXT_DEVICES>()[0];
+		bool local_H_16 = adaptive_bins && bin_count > 256
+			&& H_size + cl::Kernel(program, "get_H_16_local").getWorkGroupInfo<CL_KERNEL_LOCAL_MEM_SIZE>(device) <= device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>();
+		size_t kernel1_global_elements_16_local = std::min(kernel1_global_elements_8, 4 * device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>() * local_elements_8);
+
+		/*
+		the sparse cumulative histogram of a 16-bit image replaces the optimised cumulative histogram kernel and its helper kernels;
+		Auto-levels Mode and statistics mode need a complete cumulative histogram, so they keep the dense one
+		*/
+		bool sparse_CH = sparse && bin_count > 256 && (mode_id == 0 || mode_id == 1) && !auto_levels && !stats;
+		size_t bitmap_elements = bin_count / 32; // number of elements in the bitmap of occupied bins
+		size_t local_elements_sparse = 1;
+
+		// the scans of the sparse kernels require the number of local elements to be a power of 2
+		if (sparse_CH)
+		{
+			size_t max_local_elements_sparse = cl::Kernel(program, "get_sparse_lut").getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(context.getInfo<CL_CONTEXT_DEVICES>()[0]);
+
+			while (local_elements_sparse * 2 <= max_local_elements_sparse && local_elements_sparse < 256)
+				local_elements_sparse *= 2;
+		} // end if
+
 		size_t local_elements_16 = cl::Kernel(program, "get_CH_pro").getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(context.getInfo<CL_CONTEXT_DEVICES>()[0]); // get the max kernel workgroup size as the number of local elements when processing a 16-bit image
+
+		// with adaptive bins, a few bins may be fewer than the max kernel workgroup size (both are basically powers of 2)
+		local_elements_16 = std::min(local_elements_16, H_elements);
+
 		size_t local_size_16 = local_elements_16 * sizeof(standard); // size in bytes
 		size_t group_count = bin_count == 256 ? 1 : CH_elements / local_elements_16;
 
 		/*
 		avoid wrong results caused by an optimised cumulative histogram helper kernel due to its limitation;
 		this is affected by the number of local elements when processing a 16-bit image;
-		the limitation is seldom reached as the number is basically a power of 2 and the number of elements in vector CH is 2 to the power of 16
+		the limitation is seldom reached as the number is basically a power of 2 and the number of elements in vector CH is a power of 2 (2 to the power of 16 unless adaptive bins are used)
 		*/
-		mode_id = (mode_id == 1 && bin_count == 65536 && (group_count & (group_count - 1))) ? 0 : mode_id;
+		mode_id = (mode_id == 1 && bin_count > 256 && !sparse_CH && (group_count & (group_count - 1))) ? 0 : mode_id;
 
 		/*
 		the following part adjusts the length of global elements of the cumulative histogram kernel for a 16-bit image;
@@ -201,38 +1273,90 @@ int main(int argc, char **argv)
 		if (kernel2_global_elements_16_padding)
 			kernel2_global_elements_16 += (local_elements_16 - kernel2_global_elements_16_padding);
 
-		std::vector<standard> BS(group_count, 0); // create a separate vector whose length is equal to the number of work groups to store the block sums
-		size_t BS_size = BS.size() * sizeof(standard); // size in bytes
+		size_t BS_size = group_count * sizeof(standard); // size in bytes of the block sums, 1 per work group
+		size_t BS_scanned_size = group_count * sizeof(standard); // size in bytes of the exclusive scan of the block sums
+		size_t LUT_size = CH_elements * sizeof(standard); // size in bytes of a normalised cumulative histogram which is used as a look-up table (LUT)
 
-		std::vector<standard> BS_scanned(group_count, 0); // create a separate vector whose length is equal to the number of work groups to perform an exclusive scan on the block sums
-		size_t BS_scanned_size = BS_scanned.size() * sizeof(standard); // size in bytes
-		
-		std::vector<standard> LUT(CH_elements, 0); // vector LUT for a normalised cumulative histogram which is used as a look-up table (LUT)
-		size_t LUT_size = LUT.size() * sizeof(standard); // size in bytes
+		// host vectors of the intermediate results are only allocated in debug mode (vector CH is also allocated to get percentiles in statistics mode)
+		std::vector<standard> H, CH, BS, BS_scanned, LUT;
+
+		if (debug)
+		{
+			H.assign(H_elements, 0);
+			BS.assign(group_count, 0);
+			BS_scanned.assign(group_count, 0);
+			LUT.assign(CH_elements, 0);
+		} // end if
+
+		if (debug || stats)
+			CH.assign(CH_elements, 0);
+
+		/*
+		the cut points of Auto-levels Mode are initialised to the full range in case a target count is never reached;
+		the target counts are the number of pixels at or below the 0.5th and 99.5th percentiles
+		*/
+		std::vector<standard> cut_points = { 0, (standard)(bin_count - 1) };
+		size_t cut_points_size = cut_points.size() * sizeof(standard); // size in bytes
+		standard low_count = std::max((standard)(0.005 * input_image_width * input_image_height), (standard)1);
+		standard high_count = std::max((standard)(0.995 * input_image_width * input_image_height), low_count);
 
 		// Part 5 - device operations
 		// device - buffers
-		cl::Buffer buffer_input_image(context, CL_MEM_READ_ONLY, input_image_size); // input image buffer
-		cl::Buffer buffer_H(context, CL_MEM_READ_WRITE, H_size); // histogram buffer
+		// the input image buffer and histogram buffer have been created and filled by the fused statistics kernel in statistics mode
+		if (!stats)
+		{
+			buffer_input_image = cl::Buffer(context, in_place ? CL_MEM_READ_WRITE : CL_MEM_READ_ONLY, input_image_size); // input image buffer (also the output image buffer in in-place mode)
+			buffer_H = cl::Buffer(context, CL_MEM_READ_WRITE, H_size); // histogram buffer
+		} // end if
+
 		cl::Buffer buffer_CH(context, CL_MEM_READ_WRITE, CH_size); // cumulative histogram buffer
 		cl::Buffer buffer_BS(context, CL_MEM_READ_WRITE, BS_size); // block sum buffer for cumulative histogram helper kernels
 		cl::Buffer buffer_BS_scanned(context, CL_MEM_READ_WRITE, BS_scanned_size); // scanned block sum buffer for cumulative histogram helper kernels
-		cl::Buffer buffer_LUT(context, CL_MEM_READ_WRITE, LUT_size); // LUT buffer
-		cl::Buffer buffer_output_image(context, CL_MEM_READ_WRITE, input_image_size); // its size should be the same as that of the input image
+		cl::Buffer buffer_cut_points; // cut point buffer for Auto-levels Mode
+		cl::Buffer buffer_bitmap, buffer_bins, buffer_occupied; // bitmap, index, and number buffers of occupied bins for the sparse cumulative histogram
+
+		/*
+		in in-place mode, the LUT reuses the histogram buffer, which no kernel reads once the cumulative histogram (or the compacted histogram) is computed,
+		and the output image reuses the input image buffer, as each work item of the last kernel reads and writes the same element
+		*/
+		cl::Buffer buffer_LUT = in_place ? buffer_H : cl::Buffer(context, CL_MEM_READ_WRITE, LUT_size); // LUT buffer
+		cl::Buffer buffer_output_image = in_place ? buffer_input_image : cl::Buffer(context, CL_MEM_READ_WRITE, input_image_size); // its size should be the same as that of the input image
 
 		// 5.1 Copy the image to and initialise other arrays on device memory
-		cl::Event input_image_event, H_input_event, CH_input_event, BS_input_event, BS_scanned_input_event, LUT_input_event; // add additional events to measure the upload time of each input vector
+		cl::Event CH_input_event, BS_input_event, BS_scanned_input_event, LUT_input_event, cut_points_input_event, bitmap_input_event; // add additional events to measure the upload time of each input vector
 
-		if (bin_count == 256)
-			queue.enqueueWriteBuffer(buffer_input_image, CL_TRUE, 0, input_image_size, &input_image_8.data()[0], NULL, &input_image_event);
-		else
-			queue.enqueueWriteBuffer(buffer_input_image, CL_TRUE, 0, input_image_size, &input_image.data()[0], NULL, &input_image_event);
+		if (!stats)
+		{
+			if (bin_count == 256)
+				queue.enqueueWriteBuffer(buffer_input_image, CL_TRUE, 0, input_image_size, &input_image_8.data()[0], NULL, &input_image_event);
+			else
+				queue.enqueueWriteBuffer(buffer_input_image, CL_TRUE, 0, input_image_size, &input_image.data()[0], NULL, &input_image_event);
+
+			queue.enqueueFillBuffer(buffer_H, 0, 0, H_size, NULL, &H_input_event); // zero histogram buffer on device memory
+		} // end if
+
+		// with folded fills, every element read from the cumulative histogram and LUT is written by a kernel first
+		if (!fold_fills)
+			queue.enqueueFillBuffer(buffer_CH, 0, 0, CH_size, NULL, &CH_input_event); // zero cumulative histogram buffer on device memory
 
-		queue.enqueueFillBuffer(buffer_H, 0, 0, H_size, NULL, &H_input_event); // zero histogram buffer on device memory
-		queue.enqueueFillBuffer(buffer_CH, 0, 0, CH_size, NULL, &CH_input_event); // zero cumulative histogram buffer on device memory
-		queue.enqueueFillBuffer(buffer_LUT, 0, 0, LUT_size, NULL, &LUT_input_event); // zero LUT buffer on device memory
+		// every LUT entry looked up is written by a kernel, and the histogram must not be cleared when the LUT reuses its buffer
+		if (!in_place && !fold_fills)
+			queue.enqueueFillBuffer(buffer_LUT, 0, 0, LUT_size, NULL, &LUT_input_event); // zero LUT buffer on device memory
 
-		if (bin_count == 65536)
+		if (auto_levels)
+		{
+			buffer_cut_points = cl::Buffer(context, CL_MEM_READ_WRITE, cut_points_size);
+			queue.enqueueWriteBuffer(buffer_cut_points, CL_FALSE, 0, cut_points_size, &cut_points[0], NULL, &cut_points_input_event);
+		} // end if
+
+		if (sparse_CH)
+		{
+			buffer_bitmap = cl::Buffer(context, CL_MEM_READ_WRITE, bitmap_elements * sizeof(standard));
+			buffer_bins = cl::Buffer(context, CL_MEM_READ_WRITE, H_size); // all bins may be occupied
+			buffer_occupied = cl::Buffer(context, CL_MEM_READ_WRITE, sizeof(standard));
+			queue.enqueueFillBuffer(buffer_bitmap, 0, 0, bitmap_elements * sizeof(standard), NULL, &bitmap_input_event); // zero bitmap buffer on device memory
+		}
+		else if (bin_count > 256 && !fold_fills)
 		{
 			queue.enqueueFillBuffer(buffer_BS, 0, 0, BS_size, NULL, &BS_input_event); // zero block sum buffer on device memory
 
@@ -243,8 +1367,25 @@ int main(int argc, char **argv)
 		// 5.2 Setup and execute the kernel (i.e. device code)
 		cl::Kernel kernel1, kernel2, kernel2_helper1, kernel2_helper2, kernel2_helper3;
 
+		// use sparse versions if specified
+		if (sparse_CH)
+		{
+			std::cout << "Using sparse cumulative histogram kernels" << std::endl;
+
+			kernel1 = cl::Kernel(program, "get_H_16_bitmap"); // Step 1: get a histogram and a bitmap of its occupied bins
+			kernel2 = cl::Kernel(program, "compact_bins"); // Step 2: compact the occupied bins (the cumulative histogram is completed in Step 3)
+
+			kernel1.setArg(2, buffer_bitmap);
+
+			kernel2.setArg(2, buffer_bitmap);
+			kernel2.setArg(3, buffer_bins);
+			kernel2.setArg(4, buffer_occupied);
+			kernel2.setArg(5, cl::Local(local_elements_sparse * sizeof(standard))); // local memory size for the numbers of occupied bins
+			kernel2.setArg(6, cl::Local(local_elements_sparse * sizeof(standard)));
+			kernel2.setArg(7, (int)bitmap_elements);
+		}
 		// use optimised versions if any
-		if (mode_id == 0 || mode_id == 1)
+		else if (mode_id == 0 || mode_id == 1)
 		{
 			if (bin_count == 256)
 			{
@@ -261,12 +1402,26 @@ int main(int argc, char **argv)
 			}
 			else
 			{
-				std::cout << "Using optimised cumulative histogram kernel";
 				/*
 				Step 1: get a histogram with a specified number of bins;
-				the optimised version does not support 16-bit images
+				the optimised version does not support 16-bit images, but the local memory version supports adaptive bins fitting in local memory
 				*/
-				kernel1 = cl::Kernel(program, "get_H_16");
+				if (local_H_16)
+				{
+					std::cout << "Using local memory histogram kernel and optimised cumulative histogram kernel";
+
+					kernel1 = cl::Kernel(program, "get_H_16_local");
+
+					kernel1.setArg(2, cl::Local(H_size)); // local memory size for a local histogram
+					kernel1.setArg(3, (standard)input_image_elements);
+					kernel1.setArg(4, bin_count);
+				}
+				else
+				{
+					std::cout << "Using optimised cumulative histogram kernel";
+
+					kernel1 = cl::Kernel(program, "get_H_16");
+				} // end if...else
 
 				kernel2 = cl::Kernel(program, "get_CH_pro"); // Step 2.1: get a preliminary cumulative histogram
 				kernel2_helper1 = cl::Kernel(program, "get_BS"); // Step 2.2: get block sums of a preliminary cumulative histogram
@@ -321,13 +1476,76 @@ int main(int argc, char **argv)
 			kernel2.setArg(2, bin_count);
 		} // end if...else
 
+		// replace the kernels accumulating into zeroed buffers if fills are folded into the kernels
+		if (fold_fills)
+		{
+			std::cout << "Folding buffer zeroing into the kernels" << std::endl;
+
+			if (mode_id == 2)
+			{
+				kernel2 = cl::Kernel(program, "get_CH_gather"); // Step 2: get a cumulative histogram writing every element
+
+				kernel2.setArg(2, bin_count);
+			}
+			else if (mode_id == 0 && bin_count > 256 && !sparse_CH)
+			{
+				kernel2_helper2 = cl::Kernel(program, "get_scanned_BS_gather"); // Step 2.3: get scanned block sums writing every element
+
+				kernel2_helper2.setArg(0, buffer_BS);
+				kernel2_helper2.setArg(1, buffer_BS_scanned);
+			} // end if...else
+		} // end if
+
 		std::cout << std::endl; // leave a blank line to provide a better console output format
 		
-		cl::Kernel kernel3 = cl::Kernel(program, "get_lut"); // Step 3: get a normalised cumulative histogram as an LUT
+		cl::Kernel kernel3, kernel3_helper;
+
+		// Step 3: get an LUT
+		if (auto_levels)
+		{
+			kernel3_helper = cl::Kernel(program, "get_cut_points"); // Step 3.1: find the cut points of a linear contrast stretch
+			kernel3 = cl::Kernel(program, "get_stretch_lut"); // Step 3.2: get a linear contrast stretch as an LUT
+
+			kernel3_helper.setArg(0, buffer_CH);
+			kernel3_helper.setArg(1, buffer_cut_points);
+			kernel3_helper.setArg(2, low_count);
+			kernel3_helper.setArg(3, high_count);
+			kernel3_helper.setArg(4, bin_count);
+
+			kernel3.setArg(0, buffer_cut_points);
+			kernel3.setArg(1, buffer_LUT);
+			kernel3.setArg(2, bin_count);
+		}
+		else if (sparse_CH)
+		{
+			kernel3 = cl::Kernel(program, "get_sparse_lut"); // get a cumulative histogram of the occupied bins and their LUT entries
+
+			kernel3.setArg(0, buffer_bins);
+			kernel3.setArg(1, buffer_CH); // the compacted histogram is scanned in place
+			kernel3.setArg(2, buffer_occupied);
+			kernel3.setArg(3, buffer_LUT);
+			kernel3.setArg(4, cl::Local(local_elements_sparse * sizeof(standard))); // local memory size for a local histogram
+			kernel3.setArg(5, cl::Local(local_elements_sparse * sizeof(standard))); // local memory size for a cumulative histogram
+			kernel3.setArg(6, bin_count);
+			kernel3.setArg(7, input_image_width * input_image_height); // the total number of pixels (width * height)
+			kernel3.setArg(8, input_image.spectrum()); // the number of channels sharing the histogram
+		}
+		else
+		{
+			kernel3 = cl::Kernel(program, "get_lut"); // get a normalised cumulative histogram as an LUT
+
+			kernel3.setArg(0, buffer_CH);
+			kernel3.setArg(1, buffer_LUT);
+			kernel3.setArg(2, bin_count);
+			kernel3.setArg(3, input_image_width * input_image_height); // the total number of pixels (width * height)
+		} // end if...else
+
 		cl::Kernel kernel4;
 
 		// Step 4: get the output image according to the LUT
-		if (bin_count == 256)
+		if (bin_count == 256 && stats)
+			kernel4 = cl::Kernel(program, "get_processed_image_16_8"); // the input image buffer holds 16-bit elements in statistics mode
+		else if (bin_count == 256)
 			kernel4 = cl::Kernel(program, "get_processed_image_8");
 		else
 			kernel4 = cl::Kernel(program, "get_processed_image_16");
@@ -338,23 +1556,24 @@ int main(int argc, char **argv)
 		kernel2.setArg(0, buffer_H);
 		kernel2.setArg(1, buffer_CH);
 
-		kernel3.setArg(0, buffer_CH);
-		kernel3.setArg(1, buffer_LUT);
-		kernel3.setArg(2, bin_count);
-		kernel3.setArg(3, input_image_width * input_image_height); // the total number of pixels (width * height)
-		
 		kernel4.setArg(0, buffer_input_image);
 		kernel4.setArg(1, buffer_LUT);
 		kernel4.setArg(2, buffer_output_image);
 
-		cl::Event kernel1_event, kernel2_event, kernel2_helper1_event, kernel2_helper2_event, kernel2_helper3_event, kernel3_event, kernel4_event; // add additional events to measure the execution time of each kernel
+		cl::Event kernel2_event, kernel2_helper1_event, kernel2_helper2_event, kernel2_helper3_event, kernel3_helper_event, kernel3_event, kernel4_event; // add additional events to measure the execution time of each kernel
 
-		if ((mode_id == 0 || mode_id == 1) && bin_count == 256)
-			queue.enqueueNDRangeKernel(kernel1, cl::NullRange, cl::NDRange(kernel1_global_elements_8), cl::NDRange(local_elements_8), NULL, &kernel1_event);
-		else
-			queue.enqueueNDRangeKernel(kernel1, cl::NullRange, cl::NDRange(input_image_elements), cl::NullRange, NULL, &kernel1_event);
+		// the histogram has been computed by the fused statistics kernel in statistics mode
+		if (!stats)
+		{
+			if ((mode_id == 0 || mode_id == 1) && local_H_16 && !sparse_CH)
+				queue.enqueueNDRangeKernel(kernel1, cl::NullRange, cl::NDRange(kernel1_global_elements_16_local), cl::NDRange(local_elements_8), NULL, &kernel1_event);
+			else if ((mode_id == 0 || mode_id == 1) && bin_count == 256)
+				queue.enqueueNDRangeKernel(kernel1, cl::NullRange, cl::NDRange(kernel1_global_elements_8), cl::NDRange(local_elements_8), NULL, &kernel1_event);
+			else
+				queue.enqueueNDRangeKernel(kernel1, cl::NullRange, cl::NDRange(input_image_elements), cl::NullRange, NULL, &kernel1_event);
+		} // end if
 		
-		if ((mode_id == 0 || mode_id == 1) && bin_count == 65536)
+		if ((mode_id == 0 || mode_id == 1) && bin_count > 256 && !sparse_CH)
 		{
 			queue.enqueueNDRangeKernel(kernel2, cl::NullRange, cl::NDRange(kernel2_global_elements_16), cl::NDRange(local_elements_16), NULL, &kernel2_event);
 			queue.enqueueNDRangeKernel(kernel2_helper1, cl::NullRange, cl::NDRange(group_count), cl::NullRange, NULL, &kernel2_helper1_event);
@@ -368,38 +1587,52 @@ int main(int argc, char **argv)
 		}
 		else if ((mode_id == 0 || mode_id == 1) && bin_count == 256)
 			queue.enqueueNDRangeKernel(kernel2, cl::NullRange, cl::NDRange(H_elements), cl::NDRange(local_elements_8), NULL, &kernel2_event);
+		else if (sparse_CH)
+			queue.enqueueNDRangeKernel(kernel2, cl::NullRange, cl::NDRange(local_elements_sparse), cl::NDRange(local_elements_sparse), NULL, &kernel2_event); // a single work group
 		else
 			queue.enqueueNDRangeKernel(kernel2, cl::NullRange, cl::NDRange(H_elements), cl::NullRange, NULL, &kernel2_event);
 
-		queue.enqueueNDRangeKernel(kernel3, cl::NullRange, cl::NDRange(CH_elements), cl::NullRange, NULL, &kernel3_event);
+		if (auto_levels)
+			queue.enqueueNDRangeKernel(kernel3_helper, cl::NullRange, cl::NDRange(CH_elements), cl::NullRange, NULL, &kernel3_helper_event);
+
+		if (sparse_CH)
+			queue.enqueueNDRangeKernel(kernel3, cl::NullRange, cl::NDRange(local_elements_sparse), cl::NDRange(local_elements_sparse), NULL, &kernel3_event); // a single work group
+		else
+			queue.enqueueNDRangeKernel(kernel3, cl::NullRange, cl::NDRange(CH_elements), cl::NullRange, NULL, &kernel3_event);
 		queue.enqueueNDRangeKernel(kernel4, cl::NullRange, cl::NDRange(input_image_elements), cl::NullRange, NULL, &kernel4_event);
 
 		// 5.3 Copy the result from device to host, print info to the console, and display the output image
-		/*
-		// uncomment the following section when testing
-		queue.enqueueReadBuffer(buffer_H, CL_TRUE, 0, H_size, &H[0]);
-		queue.enqueueReadBuffer(buffer_CH, CL_TRUE, 0, CH_size, &CH[0]);
-		queue.enqueueReadBuffer(buffer_LUT, CL_TRUE, 0, LUT_size, &LUT[0]);
+		// print the intermediate results in debug mode (the histogram has been overwritten by the LUT in in-place mode)
+		if (debug)
+		{
+			if (!in_place)
+			{
+				queue.enqueueReadBuffer(buffer_H, CL_TRUE, 0, H_size, &H[0]);
 
-		std::cout << "H = " << H << std::endl;
-		std::cout << "CH = " << CH << std::endl;
+				std::cout << "H = " << H << std::endl;
+			} // end if
 
-		if ((mode_id == 0 || mode_id == 1) && bin_count == 65536)
-		{
-			queue.enqueueReadBuffer(buffer_BS, CL_TRUE, 0, BS_size, &BS[0]);
+			queue.enqueueReadBuffer(buffer_CH, CL_TRUE, 0, CH_size, &CH[0]);
+			queue.enqueueReadBuffer(buffer_LUT, CL_TRUE, 0, LUT_size, &LUT[0]);
 
-			std::cout << "BS = " << BS << std::endl;
+			std::cout << "CH = " << CH << std::endl;
 
-			if (mode_id == 0)
+			if ((mode_id == 0 || mode_id == 1) && bin_count > 256 && !sparse_CH)
 			{
-				queue.enqueueReadBuffer(buffer_BS_scanned, CL_TRUE, 0, BS_scanned_size, &BS_scanned[0]);
+				queue.enqueueReadBuffer(buffer_BS, CL_TRUE, 0, BS_size, &BS[0]);
 
-				std::cout << "BS_scanned = " << BS_scanned << std::endl;
+				std::cout << "BS = " << BS << std::endl;
+
+				if (mode_id == 0)
+				{
+					queue.enqueueReadBuffer(buffer_BS_scanned, CL_TRUE, 0, BS_scanned_size, &BS_scanned[0]);
+
+					std::cout << "BS_scanned = " << BS_scanned << std::endl;
+				} // end if
 			} // end if
+
+			std::cout << "LUT = " << LUT << std::endl;
 		} // end if
-		
-		std::cout << "LUT = " << LUT << std::endl;
-		*/
 
 		cl::Event output_image_event; // add additional events to measure the download time of each output vector
 		CImgDisplay output_image_display;
@@ -431,36 +1664,72 @@ int main(int argc, char **argv)
 			output_image_display.assign(output_image_16.resize((int)(input_image_width * scale), (int)(input_image_height * scale)), "Output image (16-bit)");
 		} // end if...else
 
-		cl_ulong total_upload_time = input_image_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - input_image_event.getProfilingInfo<CL_PROFILING_COMMAND_START>()
-			+ H_input_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - H_input_event.getProfilingInfo<CL_PROFILING_COMMAND_START>()
-			+ CH_input_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - CH_input_event.getProfilingInfo<CL_PROFILING_COMMAND_START>()
-			+ LUT_input_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - LUT_input_event.getProfilingInfo<CL_PROFILING_COMMAND_START>(); // total upload time of input vectors
-		cl_ulong kernel1_time = kernel1_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - kernel1_event.getProfilingInfo<CL_PROFILING_COMMAND_START>(); // histogram kernel execution time
+		cl_ulong total_upload_time = get_event_time(input_image_event) + get_event_time(H_input_event) + get_event_time(CH_input_event); // total upload time of input vectors (a fill folded into a kernel takes no time)
+		cl_ulong kernel1_time = kernel1_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - kernel1_event.getProfilingInfo<CL_PROFILING_COMMAND_START>() + get_event_time(stats_reduce_event); // histogram kernel execution time (including the statistics reduction in statistics mode)
 		cl_ulong kernel2_time = kernel2_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - kernel2_event.getProfilingInfo<CL_PROFILING_COMMAND_START>(); // cumulative histogram kernel execution time
 		cl_ulong total_kernel_time = kernel1_time + kernel2_time
 			+ kernel3_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - kernel3_event.getProfilingInfo<CL_PROFILING_COMMAND_START>()
 			+ kernel4_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - kernel4_event.getProfilingInfo<CL_PROFILING_COMMAND_START>(); // total execution time of kernels
 		cl_ulong output_image_download_time = output_image_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - output_image_event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
 
-		if ((mode_id == 0 || mode_id == 1) && bin_count == 65536)
+		if (!in_place)
+			total_upload_time += get_event_time(LUT_input_event);
+
+		if ((mode_id == 0 || mode_id == 1) && bin_count > 256 && !sparse_CH)
 		{
 			cl_ulong kernel2_helper_time = kernel2_helper1_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - kernel2_helper1_event.getProfilingInfo<CL_PROFILING_COMMAND_START>()
 				+ kernel2_helper2_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - kernel2_helper2_event.getProfilingInfo<CL_PROFILING_COMMAND_START>()
 				+ kernel2_helper3_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - kernel2_helper3_event.getProfilingInfo<CL_PROFILING_COMMAND_START>(); // cumulative histogram helper kernel execution time
-			total_upload_time += (BS_input_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - BS_input_event.getProfilingInfo<CL_PROFILING_COMMAND_START>());
-
-			if (mode_id == 0)
-				total_upload_time += (BS_scanned_input_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - BS_scanned_input_event.getProfilingInfo<CL_PROFILING_COMMAND_START>());
+			total_upload_time += get_event_time(BS_input_event) + get_event_time(BS_scanned_input_event);
 
 			kernel2_time += kernel2_helper_time;
 			total_kernel_time += kernel2_helper_time;
 		} // end if
 
+		if (auto_levels)
+		{
+			total_upload_time += (cut_points_input_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - cut_points_input_event.getProfilingInfo<CL_PROFILING_COMMAND_START>());
+			total_kernel_time += (kernel3_helper_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - kernel3_helper_event.getProfilingInfo<CL_PROFILING_COMMAND_START>());
+
+			queue.enqueueReadBuffer(buffer_cut_points, CL_TRUE, 0, cut_points_size, &cut_points[0]);
+
+			std::cout << "Auto-levels cut points: " << cut_points[0] << " (P0.5) and " << cut_points[1] << " (P99.5)" << std::endl;
+		} // end if
+
+		if (sparse_CH)
+		{
+			standard occupied;
+
+			total_upload_time += (bitmap_input_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - bitmap_input_event.getProfilingInfo<CL_PROFILING_COMMAND_START>());
+
+			queue.enqueueReadBuffer(buffer_occupied, CL_TRUE, 0, sizeof(standard), &occupied);
+
+			std::cout << "Occupied bins: " << occupied << " of " << bin_count << std::endl;
+		} // end if
+
+		// derive percentiles from the cumulative histogram in statistics mode
+		if (stats)
+		{
+			const double percentiles[] = { 1, 5, 25, 50, 75, 95, 99 };
+
+			queue.enqueueReadBuffer(buffer_CH, CL_TRUE, 0, CH_size, &CH[0]);
+
+			std::cout << "Image percentiles:";
+
+			for (double percentile : percentiles)
+				std::cout << " P" << percentile << " " << get_percentile(CH, percentile, input_image_width * input_image_height, mode_id != 2);
+
+			std::cout << std::endl;
+		} // end if
+
 		// display time in microseconds
 		std::cout << "Memory transfer time: " << total_upload_time / 1000 << " us" << std::endl;
 		std::cout << "Kernel execution time: " << total_kernel_time / 1000 << " us" << std::endl;
 		std::cout << "   Histogram kernel execution time: " << kernel1_time / 1000 << " us" << std::endl;
 		std::cout << "   Cumulative histogram kernel execution time: " << kernel2_time / 1000 << " us" << std::endl;
+		if (in_place)
+			std::cout << "In-place mode: the output image and LUT reuse the input image and histogram buffers" << std::endl;
+
 		std::cout << "Program execution time: " << (total_upload_time + total_kernel_time + output_image_download_time) / 1000 << " us" << std::endl;
 
 		while (!input_image_display.is_closed() && !output_image_display.is_closed()
@@ -477,6 +1746,10 @@ int main(int argc, char **argv)
 	catch (CImgException& e)
 	{
 		std::cerr << "CImg - ERROR: " << e.what() << std::endl;
+	}
+	catch (const std::runtime_error& e)
+	{
+		std::cerr << "Program - ERROR: " << e.what() << std::endl;
 	} // end try...catch
 
 	return 0;
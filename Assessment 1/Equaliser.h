@@ -0,0 +1,168 @@
+#pragma once
+
+#include <algorithm>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Utils.h"
+
+/*
+an embeddable histogram equaliser for 8-bit or 16-bit images in host memory, using the sparse cumulative histogram kernels in "kernels/assessment1_kernels.cl";
+an image may be planar or interleaved and have any number of channels, as a single histogram averaged over the channels is shared by all of them and the LUT is applied to every element;
+"EqualiseAsync" only enqueues the commands of a request and returns a future fulfilled by the OpenCL event callback of the final download,
+so the calling thread never blocks; every request has its own device buffers, so any number of requests can be in flight on the shared queues
+*/
+class Equaliser
+{
+public:
+	// the program must be built for "device", which must belong to "context"
+	Equaliser(const cl::Context& context, const cl::Device& device, const cl::Program& program, size_t queue_count = 1)
+		: context_(context), next_queue_(0), local_elements_(1)
+	{
+		for (size_t i = 0; i < std::max(queue_count, (size_t)1); i++)
+			queues_.push_back(cl::CommandQueue(context_, device, CL_QUEUE_PROFILING_ENABLE));
+
+		kernel1_8_ = cl::Kernel(program, "get_H_8_bitmap");
+		kernel1_16_ = cl::Kernel(program, "get_H_16_bitmap");
+		kernel2_ = cl::Kernel(program, "compact_bins");
+		kernel3_ = cl::Kernel(program, "get_sparse_lut");
+		kernel4_8_ = cl::Kernel(program, "get_processed_image_8");
+		kernel4_16_ = cl::Kernel(program, "get_processed_image_16");
+
+		// the scans of the sparse kernels require the number of local elements to be a power of 2
+		while (local_elements_ * 2 <= kernel3_.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device) && local_elements_ < 256)
+			local_elements_ *= 2;
+	} // end constructor
+
+	Equaliser(const Equaliser&) = delete;
+
+	/*
+	equalise "width * height * channels" elements of 8 or 16 bits ("bits") from "input" to "output" (which may be the same memory);
+	both must stay valid until the returned future is ready, and the future holds the kernel execution time in nanoseconds or the OpenCL error of the request
+	*/
+	std::future<cl_ulong> EqualiseAsync(const void* input, void* output, size_t width, size_t height, size_t channels, int bits)
+	{
+		if ((bits != 8 && bits != 16) || !width || !height || !channels)
+			throw cl::Error(CL_INVALID_VALUE, "Equaliser::EqualiseAsync");
+
+		Request* request = new Request;
+		std::future<cl_ulong> result = request->promise.get_future();
+		size_t image_elements = width * height * channels;
+		size_t image_size = image_elements * (bits == 8 ? sizeof(cl_uchar) : sizeof(cl_ushort));
+		int bin_count = bits == 8 ? 256 : 65536;
+
+		try
+		{
+			request->buffer_image = cl::Buffer(context_, CL_MEM_READ_WRITE, image_size); // the output is written over the input on the device
+			request->buffer_H = cl::Buffer(context_, CL_MEM_READ_WRITE, bin_count * sizeof(cl_uint));
+			request->buffer_CH = cl::Buffer(context_, CL_MEM_READ_WRITE, bin_count * sizeof(cl_uint));
+			request->buffer_bitmap = cl::Buffer(context_, CL_MEM_READ_WRITE, bin_count / 32 * sizeof(cl_uint));
+			request->buffer_bins = cl::Buffer(context_, CL_MEM_READ_WRITE, bin_count * sizeof(cl_uint));
+			request->buffer_occupied = cl::Buffer(context_, CL_MEM_READ_WRITE, sizeof(cl_uint));
+			request->buffer_LUT = cl::Buffer(context_, CL_MEM_READ_WRITE, bin_count * sizeof(cl_uint));
+
+			// kernel arguments are captured when a kernel is enqueued, so the shared kernels only need to be guarded while they are set and enqueued
+			std::lock_guard<std::mutex> lock(mutex_);
+			cl::CommandQueue& queue = queues_[next_queue_++ % queues_.size()];
+			cl::Kernel& kernel1 = bits == 8 ? kernel1_8_ : kernel1_16_;
+			cl::Kernel& kernel4 = bits == 8 ? kernel4_8_ : kernel4_16_;
+
+			queue.enqueueWriteBuffer(request->buffer_image, CL_FALSE, 0, image_size, input);
+			queue.enqueueFillBuffer(request->buffer_H, 0, 0, bin_count * sizeof(cl_uint)); // zero histogram buffer on device memory
+			queue.enqueueFillBuffer(request->buffer_bitmap, 0, 0, bin_count / 32 * sizeof(cl_uint)); // zero bitmap buffer on device memory
+
+			kernel1.setArg(0, request->buffer_image);
+			kernel1.setArg(1, request->buffer_H);
+			kernel1.setArg(2, request->buffer_bitmap);
+
+			kernel2_.setArg(0, request->buffer_H);
+			kernel2_.setArg(1, request->buffer_CH);
+			kernel2_.setArg(2, request->buffer_bitmap);
+			kernel2_.setArg(3, request->buffer_bins);
+			kernel2_.setArg(4, request->buffer_occupied);
+			kernel2_.setArg(5, cl::Local(local_elements_ * sizeof(cl_uint))); // local memory size for the numbers of occupied bins
+			kernel2_.setArg(6, cl::Local(local_elements_ * sizeof(cl_uint)));
+			kernel2_.setArg(7, bin_count / 32);
+
+			kernel3_.setArg(0, request->buffer_bins);
+			kernel3_.setArg(1, request->buffer_CH);
+			kernel3_.setArg(2, request->buffer_occupied);
+			kernel3_.setArg(3, request->buffer_LUT);
+			kernel3_.setArg(4, cl::Local(local_elements_ * sizeof(cl_uint))); // local memory size for a local histogram
+			kernel3_.setArg(5, cl::Local(local_elements_ * sizeof(cl_uint))); // local memory size for a cumulative histogram
+			kernel3_.setArg(6, bin_count);
+			kernel3_.setArg(7, (int)(width * height)); // the number of pixels
+			kernel3_.setArg(8, (int)channels); // the histogram is averaged over the channels
+
+			kernel4.setArg(0, request->buffer_image);
+			kernel4.setArg(1, request->buffer_LUT);
+			kernel4.setArg(2, request->buffer_image);
+
+			queue.enqueueNDRangeKernel(kernel1, cl::NullRange, cl::NDRange(image_elements), cl::NullRange, NULL, &request->kernel_events[0]);
+			queue.enqueueNDRangeKernel(kernel2_, cl::NullRange, cl::NDRange(local_elements_), cl::NDRange(local_elements_), NULL, &request->kernel_events[1]); // a single work group
+			queue.enqueueNDRangeKernel(kernel3_, cl::NullRange, cl::NDRange(local_elements_), cl::NDRange(local_elements_), NULL, &request->kernel_events[2]); // a single work group
+			queue.enqueueNDRangeKernel(kernel4, cl::NullRange, cl::NDRange(image_elements), cl::NullRange, NULL, &request->kernel_events[3]);
+			queue.enqueueReadBuffer(request->buffer_image, CL_FALSE, 0, image_size, output, NULL, &request->output_event);
+			queue.flush(); // submit the commands so that the callback fires without another call
+			request->output_event.setCallback(CL_COMPLETE, &Equaliser::OnComplete, request); // a callback set on a finished event is called at once
+		}
+		catch (const cl::Error&)
+		{
+			delete request;
+			throw;
+		} // end try...catch
+
+		return result;
+	} // end function EqualiseAsync
+
+	// wait for all requests in flight
+	void Finish()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+
+		for (cl::CommandQueue& queue : queues_)
+			queue.finish();
+	} // end function Finish
+
+private:
+	// the device buffers and events of a request, which live until its callback
+	struct Request
+	{
+		cl::Buffer buffer_image, buffer_H, buffer_CH, buffer_bitmap, buffer_bins, buffer_occupied, buffer_LUT;
+		cl::Event kernel_events[4];
+		cl::Event output_event;
+		std::promise<cl_ulong> promise;
+	};
+
+	// fulfil the future of a request when its final download finishes or fails (called by the OpenCL runtime)
+	static void CL_CALLBACK OnComplete(cl_event, cl_int status, void* user_data)
+	{
+		std::unique_ptr<Request> request(static_cast<Request*>(user_data));
+
+		try
+		{
+			if (status != CL_COMPLETE)
+				throw cl::Error(status, "Equaliser::EqualiseAsync");
+
+			cl_ulong kernel_time = 0;
+
+			for (const cl::Event& event : request->kernel_events)
+				kernel_time += event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+
+			request->promise.set_value(kernel_time);
+		}
+		catch (...)
+		{
+			request->promise.set_exception(std::current_exception());
+		} // end try...catch
+	} // end function OnComplete
+
+	cl::Context context_;
+	std::vector<cl::CommandQueue> queues_; // requests are spread over the queues in turn
+	size_t next_queue_;
+	cl::Kernel kernel1_8_, kernel1_16_, kernel2_, kernel3_, kernel4_8_, kernel4_16_;
+	size_t local_elements_;
+	std::mutex mutex_; // guards the shared kernels and the queue choice
+}; // end class Equaliser
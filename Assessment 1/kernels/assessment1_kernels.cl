@@ -37,6 +37,40 @@ kernel void get_H_16(global const ushort* image, global uint* H)
 	atomic_inc(&H[image[id]]);
 } // end function get_H_16
 
+/*
+get a histogram of a 16-bit image with a specified number of bins (local memory version);
+it is used when the number of bins is sized to the actual value range (e.g. 4096 bins for 12-bit data) and a local histogram fits in local memory;
+each work group zeroes and flushes all bins of its local histogram, so a fixed number of work groups loops over the image with a stride of the global size to amortise this;
+the sum of the elements should be equal to the total number of pixels
+*/
+kernel void get_H_16_local(global const ushort* image, global uint* H, local uint* H_local, const uint image_elements, const int bin_count)
+{
+	uint id = get_global_id(0);
+	uint global_size = get_global_size(0);
+	int local_id = get_local_id(0);
+	int local_size = get_local_size(0);
+
+	// initialise the local histogram to 0
+	for (int i = local_id; i < bin_count; i += local_size)
+		H_local[i] = 0;
+
+	barrier(CLK_LOCAL_MEM_FENCE); // wait for all local threads to finish the initialisation
+
+	/*
+	compute the local histogram;
+	take a value from the input image as a bin index of the local histogram
+	*/
+	for (uint i = id; i < image_elements; i += global_size)
+		atomic_inc(&H_local[image[i]]);
+
+	barrier(CLK_LOCAL_MEM_FENCE); // wait for all local threads to finish computing the local histogram
+
+	// write the non-empty bins of the local histogram out to the global histogram
+	for (int i = local_id; i < bin_count; i += local_size)
+		if (H_local[i])
+			atomic_add(&H[i], H_local[i]);
+} // end function get_H_16_local
+
 /*
 get a histogram of an 8-bit image with a specified number of bins (optimised version - local memory is used);
 the sum of the elements should be equal to the total number of pixels
@@ -66,6 +100,122 @@ kernel void get_H_pro(global const uchar* image, global uint* H, local uint* H_l
 		atomic_add(&H[local_id], H_local[local_id]);
 } // end function get_H_pro
 
+/*
+get a histogram of a 16-bit image together with statistics of the image in a single read (fused statistics version);
+each work group reduces the minimum, maximum, sum, and sum of squares of its elements in local memory using sequential addressing,
+and writes them to "stats[4 * group_id]" to "stats[4 * group_id + 3]" so no 64-bit atomic operation is needed;
+"scratch" should provide 4 elements per work item, and the number of local elements must be a power of 2;
+an 8-bit image loaded as a 16-bit image only occupies the first 256 bins, so the histogram can be used for both bit depths
+*/
+kernel void get_H_stats(global const ushort* image, global uint* H, global ulong* stats, local ulong* scratch, const uint image_elements)
+{
+	uint id = get_global_id(0);
+	int local_id = get_local_id(0);
+	int local_size = get_local_size(0);
+	local ulong* min_local = scratch;
+	local ulong* max_local = scratch + local_size;
+	local ulong* sum_local = scratch + 2 * local_size;
+	local ulong* sumsq_local = scratch + 3 * local_size;
+
+	// out-of-range work items keep the identities
+	if (id < image_elements)
+	{
+		ulong value = image[id];
+
+		atomic_inc(&H[value]); // take a value from the input image as a bin index of the histogram
+
+		min_local[local_id] = value;
+		max_local[local_id] = value;
+		sum_local[local_id] = value;
+		sumsq_local[local_id] = value * value;
+	}
+	else
+	{
+		min_local[local_id] = USHRT_MAX;
+		max_local[local_id] = 0;
+		sum_local[local_id] = 0;
+		sumsq_local[local_id] = 0;
+	} // end if...else
+
+	barrier(CLK_LOCAL_MEM_FENCE); // wait for all local threads to finish writing their values
+
+	// "i" represents the stride
+	for (int i = local_size / 2; i > 0; i >>= 1)
+	{
+		if (local_id < i)
+		{
+			min_local[local_id] = min(min_local[local_id], min_local[local_id + i]);
+			max_local[local_id] = max(max_local[local_id], max_local[local_id + i]);
+			sum_local[local_id] += sum_local[local_id + i];
+			sumsq_local[local_id] += sumsq_local[local_id + i];
+		} // end if
+
+		barrier(CLK_LOCAL_MEM_FENCE);
+	} // end for
+
+	// write the statistics of the work group out to global memory
+	if (!local_id)
+	{
+		int group_id = get_group_id(0);
+
+		stats[4 * group_id] = min_local[0];
+		stats[4 * group_id + 1] = max_local[0];
+		stats[4 * group_id + 2] = sum_local[0];
+		stats[4 * group_id + 3] = sumsq_local[0];
+	} // end if
+} // end function get_H_stats
+
+/*
+reduce the statistics of the work groups of "get_H_stats" to the statistics of the whole image in a single work group;
+each work item first folds a strided share of the groups, so only 4 values have to be read back by the host
+*/
+kernel void reduce_stats(global const ulong* group_stats, global ulong* stats, local ulong* scratch, const uint group_count)
+{
+	int local_id = get_local_id(0);
+	int local_size = get_local_size(0);
+	local ulong* min_local = scratch;
+	local ulong* max_local = scratch + local_size;
+	local ulong* sum_local = scratch + 2 * local_size;
+	local ulong* sumsq_local = scratch + 3 * local_size;
+
+	min_local[local_id] = USHRT_MAX;
+	max_local[local_id] = 0;
+	sum_local[local_id] = 0;
+	sumsq_local[local_id] = 0;
+
+	for (uint i = local_id; i < group_count; i += local_size)
+	{
+		min_local[local_id] = min(min_local[local_id], group_stats[4 * i]);
+		max_local[local_id] = max(max_local[local_id], group_stats[4 * i + 1]);
+		sum_local[local_id] += group_stats[4 * i + 2];
+		sumsq_local[local_id] += group_stats[4 * i + 3];
+	} // end for
+
+	barrier(CLK_LOCAL_MEM_FENCE); // wait for all local threads to finish writing their values
+
+	// "i" represents the stride
+	for (int i = local_size / 2; i > 0; i >>= 1)
+	{
+		if (local_id < i)
+		{
+			min_local[local_id] = min(min_local[local_id], min_local[local_id + i]);
+			max_local[local_id] = max(max_local[local_id], max_local[local_id + i]);
+			sum_local[local_id] += sum_local[local_id + i];
+			sumsq_local[local_id] += sumsq_local[local_id + i];
+		} // end if
+
+		barrier(CLK_LOCAL_MEM_FENCE);
+	} // end for
+
+	if (!local_id)
+	{
+		stats[0] = min_local[0];
+		stats[1] = max_local[0];
+		stats[2] = sum_local[0];
+		stats[3] = sumsq_local[0];
+	} // end if
+} // end function reduce_stats
+
 /*
 get a cumulative histogram (basic version);
 the value of the last element should be equal to the total number of pixels
@@ -82,6 +232,25 @@ kernel void get_CH(global const uint* H, global uint* CH, const int bin_count)
 		atomic_add(&CH[i], H[id] / 3);
 } // end function get_CH
 
+/*
+get a cumulative histogram (gather version);
+it is the same as kernel "get_CH" except that each work item sums the bins below its own and writes its element once,
+so the cumulative histogram buffer needs no fill before the launch
+*/
+kernel void get_CH_gather(global const uint* H, global uint* CH, const int bin_count)
+{
+	int id = get_global_id(0);
+	uint sum = 0;
+
+	if (id < bin_count)
+	{
+		for (int i = 0; i < id; i++)
+			sum += H[i] / 3;
+
+		CH[id] = sum;
+	} // end if
+} // end function get_CH_gather
+
 /*
 get a cumulative histogram (optimised version - a double-buffered version of the Hillis-Steele inclusive scan and local memory are used);
 allow only for calculating partial reductions in a single work group separately;
@@ -145,6 +314,22 @@ kernel void get_scanned_BS_1(global const uint* BS, global uint* BS_scanned)
 		atomic_add(&BS_scanned[i], BS[id]);
 } // end function get_scanned_BS_1
 
+/*
+get scanned block sums by performing an exclusive scan (a gather version of "get_scanned_BS_1");
+each work item sums the block sums below its own and writes its element once, so the scanned block sum buffer needs no fill before the launch;
+a helper kernel of the kernel for getting a cumulative histogram
+*/
+kernel void get_scanned_BS_gather(global const uint* BS, global uint* BS_scanned)
+{
+	int id = get_global_id(0);
+	uint sum = 0;
+
+	for (int i = 0; i < id; i++)
+		sum += BS[i];
+
+	BS_scanned[id] = sum;
+} // end function get_scanned_BS_gather
+
 /*
 get scanned block sums by performing an exclusive scan (a version using Blelloch exclusive scan);
 a helper kernel of the kernel for getting a cumulative histogram;
@@ -208,6 +393,267 @@ kernel void get_lut(global const uint* CH, global uint* LUT, const int bin_count
 		LUT[id] = ((ulong)CH[id] * (bin_count - 1)) / pixel_count; // use "ulong" to avoid integer overflow
 } // end function get_lut
 
+/*
+find the cut points of a linear contrast stretch in a cumulative histogram with a parallel search (auto-levels);
+each work item checks a bin, and exactly one bin crosses each target count since the cumulative histogram is non-decreasing;
+"cut_points" should be initialised to the full range (0 and "bin_count - 1") in case a target is never reached
+*/
+kernel void get_cut_points(global const uint* CH, global uint* cut_points, const uint low_count, const uint high_count, const int bin_count)
+{
+	int id = get_global_id(0);
+
+	if (id < bin_count)
+	{
+		uint previous = id ? CH[id - 1] : 0;
+
+		if (previous < low_count && CH[id] >= low_count)
+			cut_points[0] = id;
+
+		if (previous < high_count && CH[id] >= high_count)
+			cut_points[1] = id;
+	} // end if
+} // end function get_cut_points
+
+/*
+get a linear contrast stretch between 2 cut points as a look-up table (LUT) (auto-levels);
+values below the low cut point are mapped to 0 and values above the high cut point are mapped to "bin_count - 1"
+*/
+kernel void get_stretch_lut(global const uint* cut_points, global uint* LUT, const int bin_count)
+{
+	int id = get_global_id(0);
+	int low = cut_points[0];
+	int high = cut_points[1];
+
+	if (id < bin_count)
+	{
+		// keep the image unchanged if it has (almost) a single intensity
+		if (high <= low)
+			LUT[id] = id;
+		else
+			LUT[id] = ((ulong)clamp(id - low, 0, high - low) * (bin_count - 1)) / (high - low); // use "ulong" to avoid integer overflow
+	} // end if
+} // end function get_stretch_lut
+
+/*
+get a histogram of an 8-bit image together with a bitmap of its occupied bins (sparse version);
+it is the same as kernel "get_H_16_bitmap" except for the input data type
+*/
+kernel void get_H_8_bitmap(global const uchar* image, global uint* H, global uint* bitmap)
+{
+	uint id = get_global_id(0);
+	uchar value = image[id];
+
+	if (!atomic_inc(&H[value]))
+		atomic_or(&bitmap[value >> 5], 1u << (value & 31));
+} // end function get_H_8_bitmap
+
+/*
+get a histogram of a 16-bit image together with a bitmap of its occupied bins (sparse version);
+bit "value & 31" of "bitmap[value >> 5]" is set by the first pixel of each value only, so the bitmap costs one atomic operation per distinct value;
+the sum of the elements should be equal to the total number of pixels
+*/
+kernel void get_H_16_bitmap(global const ushort* image, global uint* H, global uint* bitmap)
+{
+	uint id = get_global_id(0);
+	ushort value = image[id];
+
+	if (!atomic_inc(&H[value]))
+		atomic_or(&bitmap[value >> 5], 1u << (value & 31));
+} // end function get_H_16_bitmap
+
+/*
+compact the occupied bins of a histogram marked in a bitmap (sparse version - a single work group and local memory are used);
+each work item counts the occupied bins of a contiguous range of bitmap words, an exclusive scan of the numbers gives the position of its first occupied bin,
+and the occupied bins are written in ascending order to "bins" with their values to "counts"; the number of occupied bins is written to "count"
+*/
+kernel void compact_bins(global const uint* H, global uint* counts, global const uint* bitmap, global uint* bins, global uint* count,
+	local uint* scratch_1, local uint* scratch_2, const int word_count)
+{
+	int local_id = get_local_id(0);
+	int local_size = get_local_size(0);
+	int words_per_item = (word_count + local_size - 1) / local_size;
+	int first_word = min(local_id * words_per_item, word_count);
+	int last_word = min(first_word + words_per_item, word_count);
+	uint occupied = 0;
+	local uint* scratch; // used for buffer swap
+
+	for (int i = first_word; i < last_word; i++)
+		occupied += popcount(bitmap[i]);
+
+	scratch_1[local_id] = occupied;
+
+	barrier(CLK_LOCAL_MEM_FENCE); // wait for all local threads to finish counting
+
+	// "i" represents the stride
+	for (int i = 1; i < local_size; i *= 2)
+	{
+		if (local_id >= i)
+			scratch_2[local_id] = scratch_1[local_id] + scratch_1[local_id - i];
+		else
+			scratch_2[local_id] = scratch_1[local_id];
+
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		// buffer swap
+		scratch = scratch_2;
+		scratch_2 = scratch_1;
+		scratch_1 = scratch;
+	} // end for
+
+	uint position = scratch_1[local_id] - occupied; // the exclusive scan excludes the number of the work item itself
+
+	for (int i = first_word; i < last_word; i++)
+	{
+		uint word = bitmap[i];
+
+		// visit the set bits from the lowest one so that the bins stay in ascending order
+		while (word)
+		{
+			uint bin = 32 * i + 31 - clz(word & (0u - word));
+
+			bins[position] = bin;
+			counts[position] = H[bin];
+			position++;
+			word &= word - 1; // clear the lowest set bit
+		} // end while
+	} // end for
+
+	if (local_id == local_size - 1)
+		*count = scratch_1[local_id];
+} // end function compact_bins
+
+/*
+get a cumulative histogram of the occupied bins and write the LUT entries of these bins only (sparse version - a single work group and local memory are used);
+the compacted counts are scanned in place in chunks of the work group size with the total of previous chunks carried over,
+so the work scales with the number of occupied bins rather than the number of bins;
+entries of unoccupied bins are left untouched as no pixel looks them up;
+the histogram counts the elements of all "channels" channels, so it is averaged over them to get the counts of "pixel_count" pixels
+*/
+kernel void get_sparse_lut(global const uint* bins, global uint* counts, global const uint* count, global uint* LUT,
+	local uint* scratch_1, local uint* scratch_2, const int bin_count, const int pixel_count, const int channels)
+{
+	int local_id = get_local_id(0);
+	int local_size = get_local_size(0);
+	uint occupied = *count;
+	uint carry = 0; // the total of previous chunks
+
+	for (uint base = 0; base < occupied; base += local_size)
+	{
+		uint i = base + local_id;
+		local uint* H_local = scratch_1;
+		local uint* CH_local = scratch_2;
+		local uint* scratch; // used for buffer swap
+
+		H_local[local_id] = i < occupied ? counts[i] : 0;
+
+		barrier(CLK_LOCAL_MEM_FENCE); // wait for all local threads to finish copying from global to local memory
+
+		// "j" represents the stride
+		for (int j = 1; j < local_size; j *= 2)
+		{
+			if (local_id >= j)
+				CH_local[local_id] = H_local[local_id] + H_local[local_id - j];
+			else
+				CH_local[local_id] = H_local[local_id];
+
+			barrier(CLK_LOCAL_MEM_FENCE);
+
+			// buffer swap
+			scratch = CH_local;
+			CH_local = H_local;
+			H_local = scratch;
+		} // end for
+
+		/*
+		an average histogram is used for enabling basic histogram equalisation on both monochrome and colour images (as kernel "get_CH_pro" does for 3 channels);
+		use "ulong" to avoid integer overflow (the same as kernel "get_lut")
+		*/
+		if (i < occupied)
+		{
+			uint cumulative = (carry + H_local[local_id]) / channels;
+
+			counts[i] = cumulative;
+			LUT[bins[i]] = ((ulong)cumulative * (bin_count - 1)) / pixel_count;
+		} // end if
+
+		carry += H_local[local_size - 1];
+
+		barrier(CLK_LOCAL_MEM_FENCE); // wait for all local threads to finish reading the chunk before the next one overwrites it
+	} // end for
+} // end function get_sparse_lut
+
+/*
+update an exponentially smoothed histogram with the histogram of a new frame (video mode);
+the difference between the smoothed histogram and the one the current LUT was built from is accumulated in "change" (rounded per bin),
+so that the LUT kernel can skip a frame whose histogram hardly changes; "alpha" is the weight of the new frame, and an "alpha" of 1 restarts the smoothing
+*/
+kernel void smooth_H(global const uint* H, global float* H_smoothed, global const float* H_reference, global uint* change, const float alpha)
+{
+	int id = get_global_id(0);
+	float value = alpha * H[id] + (1 - alpha) * H_smoothed[id];
+	uint difference = (uint)(fabs(value - H_reference[id]) + 0.5f);
+
+	H_smoothed[id] = value;
+
+	if (difference)
+		atomic_add(change, difference);
+} // end function smooth_H
+
+/*
+get a normalised cumulative histogram of the smoothed histogram as a look-up table (LUT) (video mode - a single work group and local memory are used);
+the whole kernel is skipped if the smoothed histogram has changed by at most "threshold" since the last LUT, so the previous LUT is reused without a round trip to the host;
+otherwise the smoothed histogram is scanned in chunks of the work group size with the total of previous chunks carried over, and becomes the new reference;
+the smoothed histogram sums to the number of image elements, so the value of the last element should be equal to "bin_count - 1"
+*/
+kernel void get_video_lut(global const float* H_smoothed, global float* H_reference, global uint* LUT, global const uint* change,
+	local float* scratch_1, local float* scratch_2, const uint threshold, const int bin_count, const uint image_elements)
+{
+	if (*change <= threshold)
+		return;
+
+	int local_id = get_local_id(0);
+	int local_size = get_local_size(0);
+	float carry = 0; // the total of previous chunks
+
+	for (int base = 0; base < bin_count; base += local_size)
+	{
+		int i = base + local_id;
+		local float* H_local = scratch_1;
+		local float* CH_local = scratch_2;
+		local float* scratch; // used for buffer swap
+
+		H_local[local_id] = i < bin_count ? H_smoothed[i] : 0;
+
+		barrier(CLK_LOCAL_MEM_FENCE); // wait for all local threads to finish copying from global to local memory
+
+		// "j" represents the stride
+		for (int j = 1; j < local_size; j *= 2)
+		{
+			if (local_id >= j)
+				CH_local[local_id] = H_local[local_id] + H_local[local_id - j];
+			else
+				CH_local[local_id] = H_local[local_id];
+
+			barrier(CLK_LOCAL_MEM_FENCE);
+
+			// buffer swap
+			scratch = CH_local;
+			CH_local = H_local;
+			H_local = scratch;
+		} // end for
+
+		if (i < bin_count)
+		{
+			LUT[i] = min((uint)((carry + H_local[local_id]) * (bin_count - 1) / image_elements), (uint)(bin_count - 1));
+			H_reference[i] = H_smoothed[i];
+		} // end if
+
+		carry += H_local[local_size - 1];
+
+		barrier(CLK_LOCAL_MEM_FENCE); // wait for all local threads to finish reading the chunk before the next one overwrites it
+	} // end for
+} // end function get_video_lut
+
 // get the output 8-bit image according to the LUT
 kernel void get_processed_image_8(global const uchar* input_image, global const uint* LUT, global uchar* output_image)
 {
@@ -215,9 +661,39 @@ kernel void get_processed_image_8(global const uchar* input_image, global const
 	output_image[id] = LUT[input_image[id]];
 } // end function get_processed_image_8
 
+/*
+get the output 8-bit image according to the LUT from an 8-bit image loaded as a 16-bit image;
+it is used when the bit depth is chosen on the device by the fused statistics kernel
+*/
+kernel void get_processed_image_16_8(global const ushort* input_image, global const uint* LUT, global uchar* output_image)
+{
+	uint id = get_global_id(0);
+	output_image[id] = LUT[input_image[id]];
+} // end function get_processed_image_16_8
+
 // get the output 16-bit image according to the LUT
 kernel void get_processed_image_16(global const ushort* input_image, global const uint* LUT, global ushort* output_image)
 {
 	uint id = get_global_id(0);
 	output_image[id] = LUT[input_image[id]];
-} // end function get_processed_image_16
\ No newline at end of file
+} // end function get_processed_image_16
+
+/*
+copy an 8-bit image slice into a buffer allocated for a device;
+it is used to first-touch the host memory of the buffer on the NUMA node of the (sub-)device running the kernel
+*/
+kernel void copy_image_8(global const uchar* input_image, global uchar* output_image)
+{
+	uint id = get_global_id(0);
+	output_image[id] = input_image[id];
+} // end function copy_image_8
+
+/*
+copy a 16-bit image slice into a buffer allocated for a device;
+it is used to first-touch the host memory of the buffer on the NUMA node of the (sub-)device running the kernel
+*/
+kernel void copy_image_16(global const ushort* input_image, global ushort* output_image)
+{
+	uint id = get_global_id(0);
+	output_image[id] = input_image[id];
+} // end function copy_image_16
\ No newline at end of file
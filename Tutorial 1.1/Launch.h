@@ -0,0 +1,142 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Utils.h"
+
+/*
+a kernel launch overhead microbenchmark using kernel "empty" in "kernels/my_kernels.cl";
+the latency of a launch is broken down into the same stages as "GetFullProfilingInfo" (queued, submitted, executed) and averaged over many launches,
+the throughput is measured with at most a given number of launches in flight (the queue is finished after each batch of that many),
+and the host costs of "setArg" and of constructing a "cl::Kernel" are timed on the host alone;
+the results show how much fusing kernels saves per launch removed on a runtime
+*/
+class LaunchBenchmark
+{
+public:
+	LaunchBenchmark(const cl::Context& context, const cl::CommandQueue& queue, const cl::Program& program)
+		: context_(context), queue_(queue), program_(program), kernel_(program, "empty")
+	{
+	} // end constructor
+
+	// get the average latency breakdown of "launches" launches, each waited for before the next one, in the format of "GetFullProfilingInfo"
+	string MeasureLatency(int launches, ProfilingResolution resolution_selection)
+	{
+		cl_ulong queued = 0, submitted = 0, executed = 0, total = 0;
+		cl::Event event;
+		auto resolution = static_cast<int>(resolution_selection);
+
+		queue_.enqueueNDRangeKernel(kernel_, cl::NullRange, cl::NDRange(1), cl::NullRange); // warm up
+		queue_.finish();
+
+		for (int i = 0; i < launches; i++)
+		{
+			queue_.enqueueNDRangeKernel(kernel_, cl::NullRange, cl::NDRange(1), cl::NullRange, NULL, &event);
+			event.wait();
+
+			ProfilingStages stages = GetProfilingStages(event);
+
+			queued += stages.queued;
+			submitted += stages.submitted;
+			executed += stages.executed;
+			total += stages.total;
+		} // end for
+
+		stringstream sstream;
+
+		sstream << "Queued " << (double)queued / launches / resolution;
+		sstream << ", Submitted " << (double)submitted / launches / resolution;
+		sstream << ", Executed " << (double)executed / launches / resolution;
+		sstream << ", Total " << (double)total / launches / resolution;
+
+		return sstream.str();
+	} // end function MeasureLatency
+
+	// get the average host time in microseconds per launch of "launches" launches on a queue with at most "depth" launches in flight
+	double MeasureThroughput(const cl::CommandQueue& queue, int launches, int depth)
+	{
+		queue.enqueueNDRangeKernel(kernel_, cl::NullRange, cl::NDRange(1), cl::NullRange); // warm up
+		queue.finish();
+
+		auto start = std::chrono::steady_clock::now();
+
+		for (int i = 0; i < launches; i++)
+		{
+			queue.enqueueNDRangeKernel(kernel_, cl::NullRange, cl::NDRange(1), cl::NullRange);
+
+			if ((i + 1) % depth == 0)
+				queue.finish();
+		} // end for
+
+		queue.finish();
+
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() / 1000.0 / launches;
+	} // end function MeasureThroughput
+
+	// get the average host time in nanoseconds of a "setArg" call with a buffer argument (on kernel "add")
+	double MeasureSetArg(int calls)
+	{
+		cl::Kernel kernel(program_, "add");
+		cl::Buffer buffer(context_, CL_MEM_READ_WRITE, sizeof(int));
+		auto start = std::chrono::steady_clock::now();
+
+		for (int i = 0; i < calls; i++)
+			kernel.setArg(i % 3, buffer);
+
+		return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() / calls;
+	} // end function MeasureSetArg
+
+	// get the average host time in microseconds of constructing a "cl::Kernel" from the built program
+	double MeasureKernelConstruction(int count)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		for (int i = 0; i < count; i++)
+			cl::Kernel kernel(program_, "empty");
+
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() / 1000.0 / count;
+	} // end function MeasureKernelConstruction
+
+	// run all measurements on the queue, and compare an in-order queue with an out-of-order queue if the device supports one
+	string Run()
+	{
+		stringstream report;
+		const int launches = 4096;
+		int depths[] = { 1, 2, 4, 8, 16, 32, 64, 128, 256, launches };
+		cl::Device device = queue_.getInfo<CL_QUEUE_DEVICE>();
+
+		report << "Empty kernel latency (unit: us): " << MeasureLatency(launches / 4, ProfilingResolution::PROF_US) << std::endl;
+		report << "Empty kernel throughput by launches in flight (unit: us per launch):";
+
+		for (int depth : depths)
+			report << (depth == 1 ? " " : ", ") << depth << " " << MeasureThroughput(queue_, launches, depth);
+
+		report << std::endl;
+
+		if (device.getInfo<CL_DEVICE_QUEUE_PROPERTIES>() & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE)
+		{
+			cl::CommandQueue in_order_queue(context_, device);
+			cl::CommandQueue out_of_order_queue(context_, device, CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE);
+
+			report << "In-order vs out-of-order queue without profiling (unit: us per launch): " << MeasureThroughput(in_order_queue, launches, launches);
+			report << " vs " << MeasureThroughput(out_of_order_queue, launches, launches) << std::endl;
+		}
+		else
+			report << "In-order vs out-of-order queue: out-of-order execution is not supported by the device" << std::endl;
+
+		report << "setArg with a buffer (unit: ns): " << MeasureSetArg(launches * 16) << std::endl;
+		report << "cl::Kernel construction (unit: us): " << MeasureKernelConstruction(launches / 4) << std::endl;
+
+		return report.str();
+	} // end function Run
+
+private:
+	cl::Context context_;
+	cl::CommandQueue queue_; // a queue with profiling enabled
+	cl::Program program_;
+	cl::Kernel kernel_;
+}; // end class LaunchBenchmark
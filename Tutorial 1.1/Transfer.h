@@ -0,0 +1,244 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Utils.h"
+
+// ways of moving data between host memory and a device buffer
+enum class TransferMethod
+{
+	PAGEABLE, // read/write a device buffer from/to ordinary (pageable) host memory
+	PINNED, // read/write a device buffer from/to a mapped "CL_MEM_ALLOC_HOST_PTR" staging buffer (pinned host memory)
+	MAPPED, // map a device buffer and copy between the mapped region and pageable host memory
+	USE_HOST_PTR // copy between a device buffer and a "CL_MEM_USE_HOST_PTR" buffer over page-aligned host memory
+};
+
+/*
+a host/device transfer microbenchmark sweeping transfer sizes for each method, direction, and blocking mode;
+times are measured on the host from the first enqueue to the end of "finish", so the copies made by the host for mapped transfers are included;
+a blocking sweep waits for each transfer before the next one, and a non-blocking sweep enqueues all repeats before waiting once,
+so the difference shows how much the runtime overlaps consecutive transfers
+*/
+class TransferBenchmark
+{
+public:
+	TransferBenchmark(const cl::Context& context, const cl::CommandQueue& queue) : context_(context), queue_(queue)
+	{
+		max_size_ = queue_.getInfo<CL_QUEUE_DEVICE>().getInfo<CL_DEVICE_MAX_MEM_ALLOC_SIZE>();
+	} // end constructor
+
+	static const char* GetMethodName(TransferMethod method)
+	{
+		switch (method)
+		{
+		case TransferMethod::PAGEABLE:
+		default:
+			return "pageable";
+
+		case TransferMethod::PINNED:
+			return "pinned staging";
+
+		case TransferMethod::MAPPED:
+			return "map/unmap";
+
+		case TransferMethod::USE_HOST_PTR:
+			return "USE_HOST_PTR";
+		} // end switch-case
+	} // end function GetMethodName
+
+	// get the transfer sizes in bytes from 4 KB to 2 GB (each 4 times the previous one, and 2 GB last) not exceeding the max buffer size of the device
+	std::vector<size_t> GetSizes() const
+	{
+		std::vector<size_t> sizes;
+		cl_ulong max_size = std::min(max_size_, (cl_ulong)2 << 30);
+
+		for (cl_ulong size = 4 << 10; size <= max_size && size < ((cl_ulong)2 << 30); size *= 4)
+			sizes.push_back((size_t)size);
+
+		if (max_size == ((cl_ulong)2 << 30) && (size_t)max_size == max_size)
+			sizes.push_back((size_t)max_size);
+
+		return sizes;
+	} // end function GetSizes
+
+	// measure the bandwidth in GB/s of "repeats" transfers of "size" bytes (one more transfer is made beforehand to warm up)
+	double Measure(TransferMethod method, bool upload, bool blocking, size_t size, int repeats)
+	{
+		std::vector<char> host_storage; // pageable host memory, from which page-aligned host memory is carved out for "CL_MEM_USE_HOST_PTR"
+		cl::Buffer buffer_device(context_, CL_MEM_READ_WRITE, size);
+		cl::Buffer buffer_host; // the staging buffer or the buffer over host memory
+		char* host_ptr; // the host memory transfers read or write
+
+		// only the methods reading or writing pageable memory allocate it, so a sweep is not limited by host memory the method does not use
+		if (method == TransferMethod::PAGEABLE || method == TransferMethod::MAPPED)
+		{
+			host_storage.assign(size, 1);
+			host_ptr = &host_storage[0];
+		}
+		else if (method == TransferMethod::PINNED)
+		{
+			buffer_host = cl::Buffer(context_, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, size);
+			host_ptr = (char*)queue_.enqueueMapBuffer(buffer_host, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, size); // the staging buffer stays mapped during the measurement
+		}
+		else // TransferMethod::USE_HOST_PTR
+		{
+			size_t alignment = 4096; // a page, which is enough for zero-copy buffers on common runtimes
+
+			host_storage.assign(size + alignment, 1);
+			host_ptr = &host_storage[0] + (alignment - (size_t)&host_storage[0] % alignment) % alignment;
+			buffer_host = cl::Buffer(context_, CL_MEM_READ_WRITE | CL_MEM_USE_HOST_PTR, size, host_ptr);
+		} // end if...else
+
+		Transfer(method, upload, blocking, buffer_device, buffer_host, host_ptr, size);
+		queue_.finish();
+
+		auto start = std::chrono::steady_clock::now();
+
+		for (int i = 0; i < repeats; i++)
+			Transfer(method, upload, blocking, buffer_device, buffer_host, host_ptr, size);
+
+		queue_.finish();
+
+		double elapsed = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+		if (method == TransferMethod::PINNED)
+		{
+			queue_.enqueueUnmapMemObject(buffer_host, host_ptr);
+			queue_.finish();
+		} // end if
+
+		return (double)size * repeats / std::max(elapsed, 1.0); // bytes per nanosecond is GB/s
+	} // end function Measure
+
+	/*
+	sweep all sizes for a method, a direction, and a blocking mode, and get the bandwidth curve as a line of "<size> <GB/s>" pairs;
+	a size which cannot be allocated on the host or the device ends the curve
+	*/
+	string Sweep(TransferMethod method, bool upload, bool blocking)
+	{
+		stringstream curve;
+		const char* separator = " ";
+
+		curve << GetMethodName(method) << ", " << (upload ? "upload" : "download") << ", " << (blocking ? "blocking" : "non-blocking") << " (unit: GB/s):";
+
+		for (size_t size : GetSizes())
+		{
+			// move at least 256 MB or 3 transfers per size to keep the timer resolution out of the results
+			int repeats = (int)std::max((size_t)3, std::min((size_t)1000, ((size_t)256 << 20) / size));
+
+			try
+			{
+				double bandwidth = Measure(method, upload, blocking, size, repeats);
+
+				curve << separator << GetSizeName(size) << " " << bandwidth;
+			}
+			catch (const cl::Error& err)
+			{
+				curve << separator << GetSizeName(size) << " n/a (" << getErrorString(err.err()) << ")";
+				break;
+			}
+			catch (const std::bad_alloc&)
+			{
+				curve << separator << GetSizeName(size) << " n/a (out of host memory)";
+				break;
+			} // end try...catch
+
+			separator = ", ";
+		} // end for
+
+		return curve.str();
+	} // end function Sweep
+
+	// sweep every method in both directions, blocking and non-blocking
+	string Run()
+	{
+		stringstream report;
+		TransferMethod methods[] = { TransferMethod::PAGEABLE, TransferMethod::PINNED, TransferMethod::MAPPED, TransferMethod::USE_HOST_PTR };
+
+		for (TransferMethod method : methods)
+			for (int upload = 1; upload >= 0; upload--)
+				for (int blocking = 1; blocking >= 0; blocking--)
+					report << Sweep(method, upload == 1, blocking == 1) << std::endl;
+
+		return report.str();
+	} // end function Run
+
+	static string GetSizeName(size_t size)
+	{
+		if (size >= (1 << 30))
+			return std::to_string(size >> 30) + " GB";
+		else if (size >= (1 << 20))
+			return std::to_string(size >> 20) + " MB";
+		else
+			return std::to_string(size >> 10) + " KB";
+	} // end function GetSizeName
+
+private:
+	// make a single transfer of "size" bytes
+	void Transfer(TransferMethod method, bool upload, bool blocking, const cl::Buffer& buffer_device, const cl::Buffer& buffer_host, char* host_ptr, size_t size)
+	{
+		switch (method)
+		{
+		case TransferMethod::PAGEABLE:
+		case TransferMethod::PINNED:
+		default:
+			if (upload)
+				queue_.enqueueWriteBuffer(buffer_device, blocking ? CL_TRUE : CL_FALSE, 0, size, host_ptr);
+			else
+				queue_.enqueueReadBuffer(buffer_device, blocking ? CL_TRUE : CL_FALSE, 0, size, host_ptr);
+			break;
+
+		case TransferMethod::MAPPED:
+		{
+			// the host copies between the mapped region and host memory, so the map itself always blocks and a non-blocking transfer only leaves the unmap in flight
+			void* mapped = queue_.enqueueMapBuffer(buffer_device, CL_TRUE, upload ? CL_MAP_WRITE_INVALIDATE_REGION : CL_MAP_READ, 0, size);
+
+			if (upload)
+				memcpy(mapped, host_ptr, size);
+			else
+				memcpy(host_ptr, mapped, size);
+
+			queue_.enqueueUnmapMemObject(buffer_device, mapped);
+
+			if (blocking)
+				queue_.finish();
+
+			break;
+		}
+
+		case TransferMethod::USE_HOST_PTR:
+		{
+			// mapping the buffer over host memory hands the memory between the host and the device, which costs no copy if the runtime uses the memory in place
+			void* mapped;
+
+			if (upload)
+			{
+				mapped = queue_.enqueueMapBuffer(buffer_host, blocking ? CL_TRUE : CL_FALSE, CL_MAP_WRITE, 0, size);
+				queue_.enqueueUnmapMemObject(buffer_host, mapped);
+				queue_.enqueueCopyBuffer(buffer_host, buffer_device, 0, 0, size);
+			}
+			else
+			{
+				queue_.enqueueCopyBuffer(buffer_device, buffer_host, 0, 0, size);
+				mapped = queue_.enqueueMapBuffer(buffer_host, blocking ? CL_TRUE : CL_FALSE, CL_MAP_READ, 0, size);
+				queue_.enqueueUnmapMemObject(buffer_host, mapped);
+			} // end if...else
+
+			if (blocking)
+				queue_.finish();
+
+			break;
+		}
+		} // end switch-case
+	} // end function Transfer
+
+	cl::Context context_;
+	cl::CommandQueue queue_;
+	cl_ulong max_size_; // the max size in bytes of a buffer on the device
+}; // end class TransferBenchmark
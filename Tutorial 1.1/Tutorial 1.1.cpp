@@ -2,6 +2,8 @@
 #include <vector>
 
 #include "Utils.h"
+#include "Launch.h"
+#include "Transfer.h"
 
 void print_help()
 {
@@ -9,6 +11,9 @@ void print_help()
 	std::cerr << "  -p : select platform " << std::endl;
 	std::cerr << "  -d : select device" << std::endl;
 	std::cerr << "  -l : list all platforms and devices, and run on the first device of the first platform" << std::endl;
+	std::cerr << "  -t : run the host/device transfer benchmark (4 KB to 2 GB) on the selected device instead of the vector addition" << std::endl;
+	std::cerr << "  -a : run the host/device transfer benchmark on all devices of all platforms" << std::endl;
+	std::cerr << "  -o : run the kernel launch overhead and queue depth benchmark on the selected device instead of the vector addition" << std::endl;
 	std::cerr << "  -h : print this message" << std::endl;
 } // end function print_help
 
@@ -17,6 +22,9 @@ int main(int argc, char **argv)
 	// Part 1 - handle command line options such as device selection, verbosity, etc.
 	int platform_id = 0;
 	int device_id = 0;
+	bool transfer_benchmark = false; // measure the bandwidth of each way of moving data between host and device
+	bool all_devices = false; // run the transfer benchmark on every device instead of the selected one
+	bool launch_benchmark = false; // measure the overhead of kernel launches
 
 	for (int i = 1; i < argc; i++)
 	{
@@ -26,6 +34,12 @@ int main(int argc, char **argv)
 			device_id = atoi(argv[++i]);
 		else if (strcmp(argv[i], "-l") == 0)
 			std::cout << ListPlatformsDevices() << std::endl;
+		else if (strcmp(argv[i], "-t") == 0)
+			transfer_benchmark = true;
+		else if (strcmp(argv[i], "-a") == 0)
+			transfer_benchmark = all_devices = true;
+		else if (strcmp(argv[i], "-o") == 0)
+			launch_benchmark = true;
 		else if (strcmp(argv[i], "-h") == 0)
 		{
 			print_help();
@@ -36,6 +50,24 @@ int main(int argc, char **argv)
 	// detect any potential exceptions
 	try
 	{
+		// report a bandwidth curve per method, direction, and blocking mode for each device
+		if (transfer_benchmark)
+		{
+			vector<cl::Device> devices = all_devices ? GetAllDevices() : GetContext(platform_id, device_id).getInfo<CL_CONTEXT_DEVICES>();
+
+			for (const cl::Device& device : devices)
+			{
+				cl::Context context({ device });
+				cl::CommandQueue queue(context);
+				TransferBenchmark benchmark(context, queue);
+
+				std::cout << "Transfer benchmark on " << device.getInfo<CL_DEVICE_NAME>() << (device.getInfo<CL_DEVICE_HOST_UNIFIED_MEMORY>() ? " (unified host memory)" : "") << std::endl;
+				std::cout << benchmark.Run() << std::endl;
+			} // end for
+
+			return 0;
+		} // end if
+
 		// Part 2 - host operations
 		// 2.1 Select computing devices
 		cl::Context context = GetContext(platform_id, device_id);
@@ -65,6 +97,16 @@ int main(int argc, char **argv)
 			throw err;
 		} // end try...catch
 
+		// report the latency breakdown and throughput of empty kernel launches, and the host costs of preparing them
+		if (launch_benchmark)
+		{
+			LaunchBenchmark benchmark(context, queue, program);
+
+			std::cout << benchmark.Run() << std::endl;
+
+			return 0;
+		} // end if
+
 		// Part 3 - memory allocation
 		// host - input (comment the following 2 lines in Section 2.7)
 		// std::vector<int> A = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 }; // C++ 11 allows this type of initialisation
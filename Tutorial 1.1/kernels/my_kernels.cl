@@ -30,4 +30,9 @@ kernel void add2D(global const int* A, global const int* B, global int* C)
 	printf("id = %d x = %d y = %d w = %d h = %d\n", id, x, y, width, height);
 
 	C[id]= A[id]+ B[id];
-} // end function add2D
\ No newline at end of file
+} // end function add2D
+
+// an empty kernel measuring the overhead of a kernel launch (see "Launch.h")
+kernel void empty()
+{
+} // end function empty
\ No newline at end of file
@@ -0,0 +1,306 @@
+#pragma once
+
+#include <map>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "Utils.h"
+
+/*
+an expression template layer for element-wise operations on integer device vectors, e.g. "C = A * B + B";
+an expression is only recorded when operators are applied, and assigning it to a device vector generates one kernel for the shape of the expression,
+so an arbitrary expression costs one pass over the data instead of one launch and one temporary vector per operator;
+generated kernels are built once and cached by their source, and each work item loads and stores 4 elements with "vload4" and "vstore4";
+scalars are passed as kernel arguments "s0", "s1", ..., so the source only depends on the shape of an expression and changing a scalar does not build a new kernel
+*/
+class DeviceVector;
+class ExpressionEngine;
+
+// the kernel arguments of an expression in the order in which its leaves are visited
+struct ExpressionOperands
+{
+	std::vector<const DeviceVector*> vectors;
+	std::vector<int> scalars;
+};
+
+// the base of all expression nodes
+struct ExpressionBase
+{
+};
+
+// a leaf referring to a device vector
+struct VectorTerminal : ExpressionBase
+{
+	explicit VectorTerminal(const DeviceVector& vector) : vector(&vector) {}
+
+	// add the vector to the list of kernel arguments unless it is already there
+	void Collect(ExpressionOperands& operands) const
+	{
+		for (const DeviceVector* collected : operands.vectors)
+			if (collected == vector)
+				return;
+
+		operands.vectors.push_back(vector);
+	} // end function Collect
+
+	// the code of a vector is the variable holding its current element(s)
+	string Code(const ExpressionOperands& operands, size_t&) const
+	{
+		size_t i = 0;
+
+		while (operands.vectors[i] != vector)
+			i++;
+
+		return "v" + std::to_string(i);
+	} // end function Code
+
+	const DeviceVector* vector;
+};
+
+// a leaf holding a scalar which is applied to every element
+struct ScalarTerminal : ExpressionBase
+{
+	explicit ScalarTerminal(int value) : value(value) {}
+
+	// add the value to the list of kernel arguments (every occurrence of a scalar gets its own argument)
+	void Collect(ExpressionOperands& operands) const
+	{
+		operands.scalars.push_back(value);
+	} // end function Collect
+
+	// the code of a scalar is the kernel argument holding its value, numbered in the same order as "Collect" visits the leaves
+	string Code(const ExpressionOperands&, size_t& scalar_index) const
+	{
+		return "s" + std::to_string(scalar_index++);
+	} // end function Code
+
+	int value;
+};
+
+// a node applying a binary operator (+, -, *, /) to 2 subexpressions
+template <char Op, typename L, typename R>
+struct BinaryExpression : ExpressionBase
+{
+	BinaryExpression(const L& left, const R& right) : left(left), right(right) {}
+
+	void Collect(ExpressionOperands& operands) const
+	{
+		left.Collect(operands);
+		right.Collect(operands);
+	} // end function Collect
+
+	string Code(const ExpressionOperands& operands, size_t& scalar_index) const
+	{
+		string left_code = left.Code(operands, scalar_index); // the left operand is numbered first, as in "Collect"
+
+		return "(" + left_code + " " + Op + " " + right.Code(operands, scalar_index) + ")";
+	} // end function Code
+
+	L left;
+	R right;
+};
+
+// map an operand type to the type of its expression node
+template <typename T, typename Enable = void> struct Operand
+{
+	static const bool is_expression = false;
+};
+
+template <> struct Operand<DeviceVector>
+{
+	static const bool is_expression = true;
+	typedef VectorTerminal type;
+};
+
+template <> struct Operand<int>
+{
+	static const bool is_expression = false;
+	typedef ScalarTerminal type;
+};
+
+template <typename T> struct Operand<T, typename std::enable_if<std::is_base_of<ExpressionBase, T>::value>::type>
+{
+	static const bool is_expression = true;
+	typedef T type;
+};
+
+// operators only take part when at least one operand is a device vector or an expression
+#define EXPRESSION_OPERATOR(symbol) \
+template <typename L, typename R, typename = typename std::enable_if<Operand<L>::is_expression || Operand<R>::is_expression>::type> \
+BinaryExpression<#symbol[0], typename Operand<L>::type, typename Operand<R>::type> operator symbol(const L& left, const R& right) \
+{ \
+	return BinaryExpression<#symbol[0], typename Operand<L>::type, typename Operand<R>::type>(typename Operand<L>::type(left), typename Operand<R>::type(right)); \
+}
+
+EXPRESSION_OPERATOR(+)
+EXPRESSION_OPERATOR(-)
+EXPRESSION_OPERATOR(*)
+EXPRESSION_OPERATOR(/)
+
+#undef EXPRESSION_OPERATOR
+
+// the context, queue, and kernel cache shared by device vectors
+class ExpressionEngine
+{
+public:
+	ExpressionEngine(const cl::Context& context, const cl::CommandQueue& queue) : context_(context), queue_(queue) {}
+
+	const cl::Context& GetContext() const { return context_; }
+	const cl::CommandQueue& GetQueue() const { return queue_; }
+
+	// the event of the last evaluation, which can be used for profiling
+	const cl::Event& GetEvent() const { return event_; }
+
+	// evaluate an expression into a device vector with a single kernel launch
+	template <typename E>
+	void Evaluate(const cl::Buffer& result, size_t size, const E& expression);
+
+	// get the source of the kernel generated for an expression of vectors "v0" to "v<vector_count - 1>" and scalars "s0" to "s<scalar_count - 1>"
+	static string GetSource(size_t vector_count, size_t scalar_count, const string& code)
+	{
+		stringstream source;
+
+		source << "kernel void expression(global int* R";
+
+		for (size_t i = 0; i < vector_count; i++)
+			source << ", global const int* A" << i;
+
+		for (size_t i = 0; i < scalar_count; i++)
+			source << ", const int s" << i;
+
+		source << ", const uint N)\n{\n\tuint id = get_global_id(0);\n\n";
+		source << "\tif (4 * id + 3 < N)\n\t{\n";
+
+		for (size_t i = 0; i < vector_count; i++)
+			source << "\t\tint4 v" << i << " = vload4(id, A" << i << ");\n";
+
+		source << "\t\tvstore4(" << code << ", id, R);\n\t}\n";
+		source << "\telse\n\t\tfor (uint i = 4 * id; i < N; i++)\n\t\t{\n";
+
+		for (size_t i = 0; i < vector_count; i++)
+			source << "\t\t\tint v" << i << " = A" << i << "[i];\n";
+
+		source << "\t\t\tR[i] = " << code << ";\n\t\t}\n}\n";
+
+		return source.str();
+	} // end function GetSource
+
+private:
+	// build the kernel for a source or get the cached one
+	cl::Kernel& GetKernel(const string& source)
+	{
+		auto cached = cache_.find(source);
+
+		if (cached != cache_.end())
+			return cached->second;
+
+		cl::Program program(context_, source);
+		cl::Device device = queue_.getInfo<CL_QUEUE_DEVICE>();
+
+		try
+		{
+			program.build({ device });
+		}
+		catch (const cl::Error& err)
+		{
+			std::cout << "Build Status: " << program.getBuildInfo<CL_PROGRAM_BUILD_STATUS>(device) << std::endl;
+			std::cout << "Build Options:\t" << program.getBuildInfo<CL_PROGRAM_BUILD_OPTIONS>(device) << std::endl;
+			std::cout << "Build Log:\t " << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device) << std::endl;
+			throw err;
+		} // end try...catch
+
+		return cache_[source] = cl::Kernel(program, "expression");
+	} // end function GetKernel
+
+	cl::Context context_;
+	cl::CommandQueue queue_;
+	cl::Event event_;
+	std::map<string, cl::Kernel> cache_; // kernels by source, i.e. by the shape of an expression (scalar values are not part of it)
+}; // end class ExpressionEngine
+
+// an integer vector in device memory which can be assigned an expression
+class DeviceVector
+{
+public:
+	DeviceVector(ExpressionEngine& engine, size_t size)
+		: engine_(engine), size_(size), buffer_(engine.GetContext(), CL_MEM_READ_WRITE, size * sizeof(int))
+	{
+	} // end constructor
+
+	DeviceVector(ExpressionEngine& engine, const std::vector<int>& host)
+		: engine_(engine), size_(host.size()), buffer_(engine.GetContext(), CL_MEM_READ_WRITE, host.size() * sizeof(int))
+	{
+		engine_.GetQueue().enqueueWriteBuffer(buffer_, CL_TRUE, 0, size_ * sizeof(int), &host[0]);
+	} // end constructor
+
+	DeviceVector(const DeviceVector&) = delete;
+
+	// copy the elements of another vector
+	DeviceVector& operator=(const DeviceVector& other)
+	{
+		engine_.Evaluate(buffer_, size_, VectorTerminal(other));
+
+		return *this;
+	} // end operator=
+
+	template <typename E, typename = typename std::enable_if<std::is_base_of<ExpressionBase, E>::value>::type>
+	DeviceVector& operator=(const E& expression)
+	{
+		engine_.Evaluate(buffer_, size_, expression);
+
+		return *this;
+	} // end operator=
+
+	// copy the elements to host memory
+	std::vector<int> Read() const
+	{
+		std::vector<int> host(size_);
+
+		engine_.GetQueue().enqueueReadBuffer(buffer_, CL_TRUE, 0, size_ * sizeof(int), &host[0]);
+
+		return host;
+	} // end function Read
+
+	const cl::Buffer& GetBuffer() const { return buffer_; }
+	size_t Size() const { return size_; }
+
+private:
+	ExpressionEngine& engine_;
+	size_t size_;
+	cl::Buffer buffer_;
+}; // end class DeviceVector
+
+template <typename E>
+void ExpressionEngine::Evaluate(const cl::Buffer& result, size_t size, const E& expression)
+{
+	ExpressionOperands operands;
+	size_t scalar_index = 0;
+
+	if (!size)
+		return;
+
+	expression.Collect(operands);
+
+	// all vectors of an expression must have the same size as the result
+	for (const DeviceVector* vector : operands.vectors)
+		if (vector->Size() != size)
+			throw cl::Error(CL_INVALID_VALUE, "ExpressionEngine::Evaluate");
+
+	cl::Kernel& kernel = GetKernel(GetSource(operands.vectors.size(), operands.scalars.size(), expression.Code(operands, scalar_index)));
+	cl_uint arg = 0;
+
+	kernel.setArg(arg++, result);
+
+	for (const DeviceVector* vector : operands.vectors)
+		kernel.setArg(arg++, vector->GetBuffer());
+
+	for (int scalar : operands.scalars)
+		kernel.setArg(arg++, (cl_int)scalar);
+
+	kernel.setArg(arg, (cl_uint)size);
+
+	// each work item handles 4 elements, and the last one also handles the remainder
+	queue_.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange((size + 3) / 4), cl::NullRange, NULL, &event_);
+} // end function Evaluate
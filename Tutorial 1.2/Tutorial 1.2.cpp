@@ -2,11 +2,12 @@
 #include <vector>
 
 #include "Utils.h"
+#include "Expression.h"
 
 void print_help()
 {
 	std::cerr << "Application usage:" << std::endl;
-	std::cerr << "  -f : select kernel function (0: add, 1: mult, 2: mult + add, 3: multadd)" << std::endl;
+	std::cerr << "  -f : select kernel function (0: add, 1: mult, 2: mult + add, 3: multadd, 4: A * B + B as a generated expression kernel)" << std::endl;
 	std::cerr << "  -p : select platform " << std::endl;
 	std::cerr << "  -d : select device" << std::endl;
 	std::cerr << "  -l : list all platforms and devices, and run on the first device of the first platform" << std::endl;
@@ -116,15 +117,37 @@ int main(int argc, char** argv)
 			std::cout << "C = A * B + B" << std::endl;
 			kernel_function1 = cl::Kernel(program, "multadd");
 			break;
+
+		case 4:
+			std::cout << "C = A * B + B (expression template)" << std::endl;
+			break;
 		} // end switch-case
-		
-		kernel_function1.setArg(0, buffer_A);
-		kernel_function1.setArg(1, buffer_B);
-		kernel_function1.setArg(2, buffer_C);
 
 		// create an event and attach it to a queue command responsible for the kernel launch
 		cl::Event prof_event;
-		queue.enqueueNDRangeKernel(kernel_function1, cl::NullRange, cl::NDRange(vector_elements), cl::NullRange, NULL, &prof_event);
+
+		if (function_id == 4)
+		{
+			/*
+			the expression is recorded by the operators and compiled into a single kernel when it is assigned,
+			so it needs neither a hand-written kernel nor a temporary vector
+			*/
+			ExpressionEngine engine(context, queue);
+			DeviceVector device_A(engine, A), device_B(engine, B), device_C(engine, vector_elements);
+
+			device_C = device_A * device_B + device_B;
+			prof_event = engine.GetEvent();
+
+			queue.enqueueCopyBuffer(device_C.GetBuffer(), buffer_C, 0, 0, vector_size);
+		}
+		else
+		{
+			kernel_function1.setArg(0, buffer_A);
+			kernel_function1.setArg(1, buffer_B);
+			kernel_function1.setArg(2, buffer_C);
+
+			queue.enqueueNDRangeKernel(kernel_function1, cl::NullRange, cl::NDRange(vector_elements), cl::NullRange, NULL, &prof_event);
+		} // end if...else
 
 		if (function_id == 2)
 		{
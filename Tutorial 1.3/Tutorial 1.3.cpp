@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <vector>
 
@@ -9,14 +11,87 @@ void print_help()
 	std::cerr << "  -p : select platform " << std::endl;
 	std::cerr << "  -d : select device" << std::endl;
 	std::cerr << "  -l : list all platforms and devices, and run on the first device of the first platform" << std::endl;
+	std::cerr << "  -r : run a 1D moving average of the specified radius with kernels \"stencil_1d\" and \"moving_average_1d\" instead of kernel \"avg_filter\"" << std::endl;
+	std::cerr << "  -n : specify the number of samples of a synthetic trace for option \"-r\" (the vector A is used by default)" << std::endl;
 	std::cerr << "  -h : print this message" << std::endl;
 } // end function print_help
 
+// get the execution time of a finished command in nanoseconds
+cl_ulong get_event_time(const cl::Event& event)
+{
+	return event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+} // end function get_event_time
+
+/*
+run a moving average of a radius on a trace with the tiled stencil kernel and the sliding window kernel, and compare their results and execution time;
+the stencil kernel takes arbitrary weights, so uniform weights are passed to compare it with the sliding window kernel
+*/
+void run_moving_average(const cl::Context& context, const cl::CommandQueue& queue, const cl::Program& program, const std::vector<float>& trace, int radius)
+{
+	int N = (int)trace.size();
+	size_t trace_size = trace.size() * sizeof(float);
+	std::vector<float> weights(2 * radius + 1, 1.f / (2 * radius + 1));
+	std::vector<float> stencil_result(N), moving_average_result(N);
+	cl::Buffer buffer_trace(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, trace_size, (void*)&trace[0]);
+	cl::Buffer buffer_weights(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, weights.size() * sizeof(float), &weights[0]);
+	cl::Buffer buffer_stencil(context, CL_MEM_READ_WRITE, trace_size);
+	cl::Buffer buffer_moving_average(context, CL_MEM_READ_WRITE, trace_size);
+	cl::Device device = context.getInfo<CL_CONTEXT_DEVICES>()[0];
+	cl::Kernel stencil_kernel(program, "stencil_1d");
+	cl::Kernel moving_average_kernel(program, "moving_average_1d");
+	cl::Event stencil_event, moving_average_event;
+
+	// use the largest power of 2 not exceeding 256 or the device limits, leaving room in local memory for the halo
+	size_t local_size = 256;
+	size_t max_local_size = stencil_kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+	cl_ulong local_memory_size = device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>();
+
+	while (local_size > 1 && (local_size > max_local_size || (local_size + 2 * radius) * sizeof(float) > local_memory_size))
+		local_size /= 2;
+
+	stencil_kernel.setArg(0, buffer_trace);
+	stencil_kernel.setArg(1, buffer_stencil);
+	stencil_kernel.setArg(2, buffer_weights);
+	stencil_kernel.setArg(3, cl::Local((local_size + 2 * radius) * sizeof(float))); // local memory size for a tile plus its halo
+	stencil_kernel.setArg(4, radius);
+	stencil_kernel.setArg(5, N);
+
+	// a chunk at least as long as the window keeps the cost of the first window of each chunk at most one extra operation per element
+	int chunk = std::max(2 * radius + 1, 64);
+
+	moving_average_kernel.setArg(0, buffer_trace);
+	moving_average_kernel.setArg(1, buffer_moving_average);
+	moving_average_kernel.setArg(2, radius);
+	moving_average_kernel.setArg(3, N);
+	moving_average_kernel.setArg(4, chunk);
+
+	queue.enqueueNDRangeKernel(stencil_kernel, cl::NullRange, cl::NDRange((N + local_size - 1) / local_size * local_size), cl::NDRange(local_size), NULL, &stencil_event);
+	queue.enqueueNDRangeKernel(moving_average_kernel, cl::NullRange, cl::NDRange((N + chunk - 1) / chunk), cl::NullRange, NULL, &moving_average_event);
+	queue.enqueueReadBuffer(buffer_stencil, CL_TRUE, 0, trace_size, &stencil_result[0]);
+	queue.enqueueReadBuffer(buffer_moving_average, CL_TRUE, 0, trace_size, &moving_average_result[0]);
+
+	float max_difference = 0;
+
+	for (int i = 0; i < N; i++)
+		max_difference = std::max(max_difference, std::fabs(stencil_result[i] - moving_average_result[i]));
+
+	if (N <= 20)
+	{
+		std::cout << "A = " << trace << std::endl;
+		std::cout << "B = " << stencil_result << std::endl;
+	} // end if
+
+	std::cout << "Radius " << radius << ", " << N << " samples, max difference between kernels " << max_difference << std::endl;
+	std::cout << "Kernel execution time (unit: ns): stencil_1d " << get_event_time(stencil_event) << ", moving_average_1d " << get_event_time(moving_average_event) << std::endl;
+} // end function run_moving_average
+
 int main(int argc, char **argv)
 {
 	// Part 1 - handle command line options such as device selection, verbosity, etc.
 	int platform_id = 0;
 	int device_id = 0;
+	int radius = 0; // 0 means running kernel "avg_filter"
+	int sample_count = 0; // 0 means using the vector A
 
 	for (int i = 1; i < argc; i++)
 	{
@@ -26,6 +101,10 @@ int main(int argc, char **argv)
 			device_id = atoi(argv[++i]);
 		else if (strcmp(argv[i], "-l") == 0)
 			std::cout << ListPlatformsDevices() << std::endl;
+		else if ((strcmp(argv[i], "-r") == 0) && (i < (argc - 1)))
+			radius = atoi(argv[++i]);
+		else if ((strcmp(argv[i], "-n") == 0) && (i < (argc - 1)))
+			sample_count = atoi(argv[++i]);
 		else if (strcmp(argv[i], "-h") == 0)
 		{
 			print_help();
@@ -42,7 +121,7 @@ int main(int argc, char **argv)
 
 		std::cout << "Running on " << GetPlatformName(platform_id) << ", " << GetDeviceName(platform_id, device_id) << std::endl; // display the selected device
 
-		cl::CommandQueue queue(context); // create a queue to which we will push commands for the device
+		cl::CommandQueue queue(context, CL_QUEUE_PROFILING_ENABLE); // create a queue to which we will push commands for the device and enable profiling for the queue
 
 		// 2.2 Load & build the device code
 		cl::Program::Sources sources;
@@ -70,6 +149,25 @@ int main(int argc, char **argv)
 		C++ 11 allows this type of initialisation
 		*/
 		std::vector<int> A = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+
+		// smooth a trace with a moving average of any radius
+		if (radius > 0)
+		{
+			std::vector<float> trace(A.begin(), A.end());
+
+			// a synthetic sensor trace: a slow sine wave with deterministic noise
+			if (sample_count > 0)
+			{
+				trace.resize(sample_count);
+
+				for (int i = 0; i < sample_count; i++)
+					trace[i] = 100 * std::sin(i * 0.001f) + (float)((long long)i * 7919 % 101 - 50) / 10;
+			} // end if
+
+			run_moving_average(context, queue, program, trace, radius);
+
+			return 0;
+		} // end if
 		
 		size_t vector_elements = A.size(); // number of elements
 		size_t vector_size = A.size() * sizeof(int); // size in bytes
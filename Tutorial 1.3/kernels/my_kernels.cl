@@ -13,4 +13,61 @@ kernel void avg_filter(global const int* A, global int* B)
 		id_new = size - 2;
 
 	B[id] = (A[id_new - 1] + A[id_new] + A[id_new + 1]) / 3;
-} // end function avg_filter
\ No newline at end of file
+} // end function avg_filter
+
+/*
+a weighted 1D stencil with a radius and weights given at runtime, using local memory tiles;
+each work group loads its elements plus a halo of "radius" elements on each side into local memory once, so each input element is read from global memory about once per work group;
+the boundary conditions are handled by clamping indices to the ends of the vector;
+"weights" should hold 2 * radius + 1 elements, and "tile" should hold local size + 2 * radius elements
+*/
+kernel void stencil_1d(global const float* A, global float* B, constant float* weights, local float* tile, const int radius, const int N)
+{
+	int id = get_global_id(0);
+	int lid = get_local_id(0);
+	int local_size = get_local_size(0);
+	int origin = get_group_id(0) * local_size - radius; // index of the first element of the tile including the halo
+
+	// the tile is larger than the work group, so each work item loads several elements with strides of the work group size
+	for (int i = lid; i < local_size + 2 * radius; i += local_size)
+		tile[i] = A[clamp(origin + i, 0, N - 1)];
+
+	barrier(CLK_LOCAL_MEM_FENCE); // wait for all local threads to finish loading the tile
+
+	if (id < N)
+	{
+		float result = 0;
+
+		for (int i = 0; i <= 2 * radius; i++)
+			result += tile[lid + i] * weights[i];
+
+		B[id] = result;
+	} // end if
+} // end function stencil_1d
+
+/*
+a 1D moving average (uniform weights) for large radii using a sliding window, so the cost per element does not depend on the radius;
+each work item computes "chunk" consecutive elements: it sums the first window once and then adds the entering element and subtracts the leaving element for each next element;
+the running sum restarts in each chunk, which also bounds the accumulated rounding error;
+the boundary conditions are handled by clamping indices to the ends of the vector, the same as "stencil_1d"
+*/
+kernel void moving_average_1d(global const float* A, global float* B, const int radius, const int N, const int chunk)
+{
+	int start = get_global_id(0) * chunk;
+	int end = min(start + chunk, N);
+	float sum = 0;
+
+	if (start >= N)
+		return;
+
+	for (int i = start - radius; i <= start + radius; i++)
+		sum += A[clamp(i, 0, N - 1)];
+
+	B[start] = sum / (2 * radius + 1);
+
+	for (int i = start + 1; i < end; i++)
+	{
+		sum += A[min(i + radius, N - 1)] - A[max(i - radius - 1, 0)];
+		B[i] = sum / (2 * radius + 1);
+	} // end for
+} // end function moving_average_1d
\ No newline at end of file
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Utils.h"
+
+/*
+a cache of fused programs built on a context, keyed by their source (and device);
+it is owned by the caller and shared by all pipelines on the context, so programs live exactly as long as the cache
+*/
+class FusedProgramCache
+{
+public:
+	FusedProgramCache(const cl::Context& context) : context_(context)
+	{
+	} // end constructor
+
+	// build the source for the device or get the program built for the same source and device
+	cl::Program GetProgram(const string& source, const cl::Device& device)
+	{
+		auto key = std::make_pair(device(), source);
+		auto cached = programs_.find(key);
+
+		if (cached != programs_.end())
+			return cached->second;
+
+		cl::Program program(context_, source);
+
+		try
+		{
+			program.build({ device });
+		}
+		catch (const cl::Error& err)
+		{
+			std::cout << "Build Status: " << program.getBuildInfo<CL_PROGRAM_BUILD_STATUS>(device) << std::endl;
+			std::cout << "Build Options:\t" << program.getBuildInfo<CL_PROGRAM_BUILD_OPTIONS>(device) << std::endl;
+			std::cout << "Build Log:\t " << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device) << std::endl;
+			throw err;
+		} // end try...catch
+
+		programs_[key] = program;
+
+		return program;
+	} // end function GetProgram
+
+	const cl::Context& GetContext() const
+	{
+		return context_;
+	} // end function GetContext
+
+private:
+	cl::Context context_;
+	std::map<std::pair<cl_device_id, string>, cl::Program> programs_; // programs built on the context by their device and source
+}; // end class FusedProgramCache
+
+/*
+a builder of fused image kernels for chains of point operations and at most one stencil;
+a point operation is an OpenCL C statement updating "float4 v", the channels (RGB in x, y, z) of the current pixel with values in [0, 255];
+the stencil is a convolution with the same boundary modes as the tiled convolution kernel (0 - clamp, 1 - mirror, 2 - zero padding):
+point operations added before it are applied to every pixel it reads inside the image, and those added after it are applied to its result;
+the chain is generated as a single kernel with one work item per pixel, so a chain of N point operations costs one read and one write of the image instead of N of each;
+generated programs are cached by source in a "FusedProgramCache" shared by the pipelines of a context, so running the same chain again does not compile it again
+*/
+class FusedPipeline
+{
+public:
+	FusedPipeline(FusedProgramCache& cache, const cl::CommandQueue& queue, int boundary_mode = 0)
+		: cache_(cache), context_(cache.GetContext()), queue_(queue), mask_size_(0), boundary_mode_(boundary_mode)
+	{
+	} // end constructor
+
+	// add a point operation as an OpenCL C statement updating "v"
+	FusedPipeline& Point(const string& statement)
+	{
+		(mask_size_ ? post_operations_ : pre_operations_).push_back(statement);
+
+		return *this;
+	} // end function Point
+
+	// keep the red colour component only (the same as kernel "filter_r")
+	FusedPipeline& FilterR()
+	{
+		return Point("v.yz = 0;");
+	} // end function FilterR
+
+	// invert the intensity value of each channel (the same as kernel "invert")
+	FusedPipeline& Invert()
+	{
+		return Point("v.xyz = 255 - v.xyz;");
+	} // end function Invert
+
+	// convert a colour pixel into greyscale (the same as kernel "rgb2grey")
+	FusedPipeline& Rgb2Grey()
+	{
+		return Point("v.xyz = dot(v.xyz, (float3)(0.2126f, 0.7152f, 0.0722f));");
+	} // end function Rgb2Grey
+
+	// add a convolution with a mask of an odd size stored row by row as the only stencil
+	FusedPipeline& Convolve(const vector<float>& mask, int mask_size)
+	{
+		if (mask_size_)
+			throw cl::Error(CL_INVALID_OPERATION, "FusedPipeline::Convolve");
+
+		mask_ = mask;
+		mask_size_ = mask_size;
+
+		return *this;
+	} // end function Convolve
+
+	// get the OpenCL C source of the fused kernel "fused"
+	string GetSource() const
+	{
+		stringstream source;
+
+		// the same mapping as function "get_boundary_index" in "kernels/my_kernels.cl" (-1 means a zero pixel)
+		source << "int get_boundary_index(int i, int size)\n{\n";
+
+		if (boundary_mode_ == 1)
+		{
+			source << "\tif (size == 1)\n\t\treturn 0;\n";
+			source << "\twhile (i < 0 || i >= size)\n\t\ti = i < 0 ? -i : 2 * (size - 1) - i;\n";
+			source << "\treturn i;\n}\n\n";
+		}
+		else if (boundary_mode_ == 2)
+			source << "\treturn (i < 0 || i >= size) ? -1 : i;\n}\n\n";
+		else
+			source << "\treturn clamp(i, 0, size - 1);\n}\n\n";
+
+		source << "float4 load_pixel(global const uchar* A, int x, int y, int width, int height, int spectrum)\n{\n";
+		source << "\tint image_size = width * height;\n";
+		source << "\tx = get_boundary_index(x, width);\n\ty = get_boundary_index(y, height);\n";
+		source << "\tif (x < 0 || y < 0)\n\t\treturn (float4)(0, 0, 0, 255);\n";
+		source << "\tint id = x + y * width;\n";
+		source << "\tfloat4 v = (float4)(A[id], A[id + (spectrum > 1) * image_size], A[id + (spectrum > 2) * 2 * image_size], 255);\n";
+
+		for (const string& statement : pre_operations_)
+			source << "\t" << statement << "\n";
+
+		source << "\treturn v;\n}\n\n";
+		source << "kernel void fused(global const uchar* A, global uchar* B, constant float* mask, const int width, const int height, const int spectrum)\n{\n";
+		source << "\tint x = get_global_id(0);\n\tint y = get_global_id(1);\n\tint image_size = width * height;\n\tint id = x + y * width;\n";
+
+		if (mask_size_)
+		{
+			source << "\tfloat4 v = 0;\n";
+			source << "\tfor (int j = 0; j < " << mask_size_ << "; j++)\n";
+			source << "\t\tfor (int i = 0; i < " << mask_size_ << "; i++)\n";
+			source << "\t\t\tv += load_pixel(A, x + i - " << mask_size_ / 2 << ", y + j - " << mask_size_ / 2 << ", width, height, spectrum) * mask[i + j * " << mask_size_ << "];\n";
+		}
+		else
+			source << "\tfloat4 v = load_pixel(A, x, y, width, height, spectrum);\n";
+
+		for (const string& statement : post_operations_)
+			source << "\t" << statement << "\n";
+
+		source << "\tuchar4 result = convert_uchar4_sat_rte(v);\n";
+		source << "\tB[id] = result.x;\n";
+		source << "\tif (spectrum > 1)\n\t\tB[id + image_size] = result.y;\n";
+		source << "\tif (spectrum > 2)\n\t\tB[id + 2 * image_size] = result.z;\n}\n";
+
+		return source.str();
+	} // end function GetSource
+
+	// run the fused kernel on a planar 8-bit image and return its execution time in nanoseconds
+	cl_ulong Run(const cl::Buffer& input, const cl::Buffer& output, int width, int height, int spectrum)
+	{
+		cl::Kernel kernel(cache_.GetProgram(GetSource(), queue_.getInfo<CL_QUEUE_DEVICE>()), "fused");
+		vector<float> mask = mask_size_ ? mask_ : vector<float>(1, 0); // an unused mask still needs a valid buffer
+		cl::Buffer buffer_mask(context_, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, mask.size() * sizeof(float), &mask[0]);
+		cl::Event kernel_event;
+
+		kernel.setArg(0, input);
+		kernel.setArg(1, output);
+		kernel.setArg(2, buffer_mask);
+		kernel.setArg(3, width);
+		kernel.setArg(4, height);
+		kernel.setArg(5, spectrum);
+
+		queue_.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(width, height), cl::NullRange, NULL, &kernel_event);
+		kernel_event.wait();
+
+		return kernel_event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - kernel_event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+	} // end function Run
+
+private:
+	FusedProgramCache& cache_; // the program cache of the context shared with other pipelines
+	cl::Context context_;
+	cl::CommandQueue queue_;
+	vector<string> pre_operations_; // point operations applied before the stencil
+	vector<string> post_operations_; // point operations applied after the stencil
+	vector<float> mask_;
+	int mask_size_; // 0 means no stencil
+	int boundary_mode_; // the boundary mode of the stencil
+}; // end class FusedPipeline
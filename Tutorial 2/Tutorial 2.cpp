@@ -1,8 +1,12 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
 #include <iostream>
 #include <vector>
 
 #include "Utils.h"
 #include "CImg.h"
+#include "Fusion.h"
 
 using namespace cimg_library;
 
@@ -17,15 +21,438 @@ void print_help()
 	std::cerr << "                  2. Only a PPM image file is accepted" << std::endl;
 	std::cerr << "                  3. When using this option, please only enter the filename without the extension (i.e. test)" << std::endl;
 	std::cerr << "                  4. The specified image should be put under the folder \"images\"" << std::endl;
+	std::cerr << "  -k : specify kernel" << std::endl;
+	std::cerr << "       ATTENTION: 1. \"convolution_tiled\" is default" << std::endl;
+	std::cerr << "                  2. Available kernels: identity, filter_r, invert, rgb2grey, rgb2grey_packed, identityND, avg_filterND, convolutionND, convolution_tiled, convolution_separable," << std::endl;
+	std::cerr << "                     identity_image, avg_filter_image, convolution_image, median_filter, median_filter_histogram" << std::endl;
+	std::cerr << "  -m : specify the size of a Gaussian mask for kernels \"convolution_tiled\", \"convolution_separable\", and \"convolution_image\"" << std::endl;
+	std::cerr << "       ATTENTION: 3 is default, and the size should be odd" << std::endl;
+	std::cerr << "       The same option specifies the window size for kernels \"median_filter\" and \"median_filter_histogram\"" << std::endl;
+	std::cerr << "  -b : specify the boundary mode for kernels \"convolution_tiled\", \"convolution_separable\", and \"median_filter\"" << std::endl;
+	std::cerr << "       ATTENTION: 0 - clamp (default), 1 - mirror, 2 - zero" << std::endl;
+	std::cerr << "  -x : benchmark the tiled and separable convolution kernels with Gaussian masks of radius 1 to 25" << std::endl;
+	std::cerr << "  -i : benchmark the image object kernels against the buffer kernels" << std::endl;
+	std::cerr << "  -c : run a chain of operations as a single fused kernel instead of the selected kernel, e.g. \"invert,convolution,rgb2grey\"" << std::endl;
+	std::cerr << "       ATTENTION: 1. Available operations: filter_r, invert, rgb2grey, convolution (a Gaussian mask whose size is specified by option \"-m\")" << std::endl;
+	std::cerr << "                  2. At most one convolution is allowed, and the unfused chain is also run for comparison" << std::endl;
 	std::cerr << "  -h : print this message" << std::endl;
 } // end function print_help
 
+/*
+get a Gaussian mask of an odd size approximated with binomial coefficients;
+the mask is stored row by row, and a size of 3 gives the 3x3 mask of Section 3.2.2
+*/
+std::vector<float> get_gaussian_mask(int size)
+{
+	std::vector<float> row(size, 1);
+	std::vector<float> mask(size * size);
+	float sum = 0;
+
+	// build a row of Pascal's triangle
+	for (int i = 1; i < size; i++)
+		for (int j = i - 1; j > 0; j--)
+			row[j] += row[j - 1];
+
+	for (float value : row)
+		sum += value;
+
+	for (int j = 0; j < size; j++)
+		for (int i = 0; i < size; i++)
+			mask[i + j * size] = row[i] * row[j] / (sum * sum);
+
+	return mask;
+} // end function get_gaussian_mask
+
+/*
+choose 2D work group dimensions for a tiled kernel from the device limits;
+starting from 16x16, the larger dimension is halved until the work group fits the kernel work group size, the max work item sizes,
+and the local memory needed by a tile plus its halo of "radius" pixels
+*/
+cl::NDRange get_tile_range(const cl::Kernel& kernel, const cl::Device& device, int radius, size_t element_size)
+{
+	size_t max_group_size = kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device);
+	std::vector<size_t> max_item_sizes = device.getInfo<CL_DEVICE_MAX_WORK_ITEM_SIZES>();
+	cl_ulong local_memory_size = device.getInfo<CL_DEVICE_LOCAL_MEM_SIZE>();
+	size_t local_width = 16;
+	size_t local_height = 16;
+
+	while ((local_width * local_height > max_group_size || local_width > max_item_sizes[0] || local_height > max_item_sizes[1]
+		|| (local_width + 2 * radius) * (local_height + 2 * radius) * element_size > local_memory_size) && local_width * local_height > 1)
+	{
+		if (local_width >= local_height)
+			local_width /= 2;
+		else
+			local_height /= 2;
+	} // end while
+
+	if ((local_width + 2 * radius) * (local_height + 2 * radius) * element_size > local_memory_size)
+		throw cl::Error(CL_OUT_OF_RESOURCES, "get_tile_range");
+
+	return cl::NDRange(local_width, local_height, 1);
+} // end function get_tile_range
+
+// round a global size up to a multiple of a local size
+size_t get_padded_size(size_t global_size, size_t local_size)
+{
+	return (global_size + local_size - 1) / local_size * local_size;
+} // end function get_padded_size
+
+/*
+split a mask into a row vector and a column vector if it is rank-1 (separable);
+the row and column through the element of the largest magnitude are taken and checked against all elements of the mask
+*/
+bool get_separable_mask(const std::vector<float>& mask, int size, std::vector<float>& row, std::vector<float>& column)
+{
+	int pivot = (int)(std::max_element(mask.begin(), mask.end(), [](float a, float b) { return std::fabs(a) < std::fabs(b); }) - mask.begin());
+	int pivot_x = pivot % size;
+	int pivot_y = pivot / size;
+
+	if (mask[pivot] == 0)
+		return false;
+
+	row.assign(size, 0);
+	column.assign(size, 0);
+
+	for (int i = 0; i < size; i++)
+	{
+		row[i] = mask[i + pivot_y * size] / mask[pivot];
+		column[i] = mask[pivot_x + i * size];
+	} // end for
+
+	for (int j = 0; j < size; j++)
+		for (int i = 0; i < size; i++)
+			if (std::fabs(row[i] * column[j] - mask[i + j * size]) > 1e-6f * std::fabs(mask[pivot]))
+				return false;
+
+	return true;
+} // end function get_separable_mask
+
+// load and build the device code (the mask size and boundary mode of the tiled convolution kernels are fixed at build time)
+cl::Program build_program(const cl::Context& context, int mask_size, int boundary_mode)
+{
+	cl::Program::Sources sources;
+
+	AddSources(sources, "kernels/my_kernels.cl");
+
+	cl::Program program(context, sources);
+
+	// build and debug the kernel code
+	try
+	{
+		program.build(("-DMASK_SIZE=" + std::to_string(mask_size) + " -DBOUNDARY_MODE=" + std::to_string(boundary_mode)).c_str());
+	}
+	catch (const cl::Error& err)
+	{
+		std::cout << "Build Status: " << program.getBuildInfo<CL_PROGRAM_BUILD_STATUS>(context.getInfo<CL_CONTEXT_DEVICES>()[0]) << std::endl;
+		std::cout << "Build Options:\t" << program.getBuildInfo<CL_PROGRAM_BUILD_OPTIONS>(context.getInfo<CL_CONTEXT_DEVICES>()[0]) << std::endl;
+		std::cout << "Build Log:\t " << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(context.getInfo<CL_CONTEXT_DEVICES>()[0]) << std::endl;
+		throw err;
+	} // end try...catch
+
+	return program;
+} // end function build_program
+
+// get the execution time of a finished command in nanoseconds
+cl_ulong get_event_time(const cl::Event& event)
+{
+	return event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+} // end function get_event_time
+
+// run kernel "convolution_tiled" of a program built for "mask_size" and return its execution time in nanoseconds
+cl_ulong run_convolution_tiled(const cl::CommandQueue& queue, const cl::Program& program, const cl::Buffer& input, const cl::Buffer& output, const cl::Buffer& mask,
+	int width, int height, int spectrum, int mask_size)
+{
+	cl::Kernel kernel(program, "convolution_tiled");
+	cl::NDRange local_range = get_tile_range(kernel, queue.getInfo<CL_QUEUE_DEVICE>(), mask_size / 2, sizeof(float));
+	size_t tile_elements = (local_range[0] + mask_size - 1) * (local_range[1] + mask_size - 1);
+	cl::Event kernel_event;
+
+	kernel.setArg(0, input);
+	kernel.setArg(1, output);
+	kernel.setArg(2, mask);
+	kernel.setArg(3, cl::Local(tile_elements * sizeof(float))); // local memory size for a tile plus its halo
+	kernel.setArg(4, width);
+	kernel.setArg(5, height);
+
+	// the global size is padded to a multiple of the work group size, and the padding work items only help to load tiles
+	queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(get_padded_size(width, local_range[0]), get_padded_size(height, local_range[1]), spectrum),
+		local_range, NULL, &kernel_event);
+	kernel_event.wait();
+
+	return get_event_time(kernel_event);
+} // end function run_convolution_tiled
+
+/*
+run kernels "convolution_rows" and "convolution_columns" of a program built for "mask_size" and return their total execution time in nanoseconds;
+"intermediate" should hold width * height * spectrum floats
+*/
+cl_ulong run_convolution_separable(const cl::CommandQueue& queue, const cl::Program& program, const cl::Buffer& input, const cl::Buffer& intermediate, const cl::Buffer& output,
+	const cl::Buffer& row_mask, const cl::Buffer& column_mask, int width, int height, int spectrum, int mask_size)
+{
+	cl::Kernel row_kernel(program, "convolution_rows");
+	cl::Kernel column_kernel(program, "convolution_columns");
+	cl::NDRange local_range = get_tile_range(row_kernel, queue.getInfo<CL_QUEUE_DEVICE>(), mask_size / 2, sizeof(float));
+	cl::NDRange global_range(get_padded_size(width, local_range[0]), get_padded_size(height, local_range[1]), spectrum);
+	cl::Event row_event, column_event;
+
+	row_kernel.setArg(0, input);
+	row_kernel.setArg(1, intermediate);
+	row_kernel.setArg(2, row_mask);
+	row_kernel.setArg(3, cl::Local((local_range[0] + mask_size - 1) * local_range[1] * sizeof(float))); // local memory size for rows plus a horizontal halo
+	row_kernel.setArg(4, width);
+	row_kernel.setArg(5, height);
+
+	column_kernel.setArg(0, intermediate);
+	column_kernel.setArg(1, output);
+	column_kernel.setArg(2, column_mask);
+	column_kernel.setArg(3, cl::Local(local_range[0] * (local_range[1] + mask_size - 1) * sizeof(float))); // local memory size for columns plus a vertical halo
+	column_kernel.setArg(4, width);
+	column_kernel.setArg(5, height);
+
+	queue.enqueueNDRangeKernel(row_kernel, cl::NullRange, global_range, local_range, NULL, &row_event);
+	queue.enqueueNDRangeKernel(column_kernel, cl::NullRange, global_range, local_range, NULL, &column_event);
+	column_event.wait();
+
+	return get_event_time(row_event) + get_event_time(column_event);
+} // end function run_convolution_separable
+
+// run kernel "median_filter" of a program built for a window size of "mask_size" and return its execution time in nanoseconds
+cl_ulong run_median_filter(const cl::CommandQueue& queue, const cl::Program& program, const cl::Buffer& input, const cl::Buffer& output, int width, int height, int spectrum, int mask_size)
+{
+	cl::Kernel kernel(program, "median_filter");
+	cl::NDRange local_range = get_tile_range(kernel, queue.getInfo<CL_QUEUE_DEVICE>(), mask_size / 2, sizeof(unsigned char));
+	size_t tile_elements = (local_range[0] + mask_size - 1) * (local_range[1] + mask_size - 1);
+	cl::Event kernel_event;
+
+	kernel.setArg(0, input);
+	kernel.setArg(1, output);
+	kernel.setArg(2, cl::Local(tile_elements * sizeof(unsigned char))); // local memory size for a tile plus its halo
+	kernel.setArg(3, width);
+	kernel.setArg(4, height);
+
+	queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(get_padded_size(width, local_range[0]), get_padded_size(height, local_range[1]), spectrum),
+		local_range, NULL, &kernel_event);
+	kernel_event.wait();
+
+	return get_event_time(kernel_event);
+} // end function run_median_filter
+
+/*
+run kernel "median_filter_histogram" with a window size of "mask_size" and return its execution time in nanoseconds;
+the strips are at least 4 times as wide as the radius so that updating the column histograms of the halo costs little per pixel
+*/
+cl_ulong run_median_filter_histogram(const cl::Context& context, const cl::CommandQueue& queue, const cl::Program& program, const cl::Buffer& input, const cl::Buffer& output,
+	int width, int height, int spectrum, int mask_size)
+{
+	int radius = mask_size / 2;
+	int strip_width = std::max(64, 4 * radius);
+	int strip_count = (width + strip_width - 1) / strip_width;
+	cl::Kernel kernel(program, "median_filter_histogram");
+	cl::Buffer histograms(context, CL_MEM_READ_WRITE, (size_t)strip_count * spectrum * (strip_width + 2 * radius + 1) * 256 * sizeof(cl_uint)); // column and window histograms of each work item
+	cl::Event kernel_event;
+
+	kernel.setArg(0, input);
+	kernel.setArg(1, output);
+	kernel.setArg(2, histograms);
+	kernel.setArg(3, width);
+	kernel.setArg(4, height);
+	kernel.setArg(5, radius);
+	kernel.setArg(6, strip_width);
+
+	queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(strip_count, spectrum), cl::NullRange, NULL, &kernel_event);
+	kernel_event.wait();
+
+	return get_event_time(kernel_event);
+} // end function run_median_filter_histogram
+
+// interleave the planar channels of an image into RGBA pixels for an image object (a greyscale image is copied to RGB, and alpha is opaque)
+std::vector<unsigned char> get_rgba_image(const CImg<unsigned char>& image)
+{
+	int image_size = image.width() * image.height();
+	std::vector<unsigned char> rgba(image_size * 4, 255);
+
+	for (int i = 0; i < image_size; i++)
+		for (int c = 0; c < 3; c++)
+			rgba[i * 4 + c] = image.data()[i + (c < image.spectrum() ? c : 0) * image_size];
+
+	return rgba;
+} // end function get_rgba_image
+
+// split RGBA pixels of an image object back into planar channels
+void get_planar_image(const std::vector<unsigned char>& rgba, std::vector<unsigned char>& planar, int width, int height, int spectrum)
+{
+	int image_size = width * height;
+
+	for (int i = 0; i < image_size; i++)
+		for (int c = 0; c < spectrum && c < 4; c++)
+			planar[i + c * image_size] = rgba[i * 4 + c];
+} // end function get_planar_image
+
+// run a kernel which reads and writes image objects and return its execution time in nanoseconds
+cl_ulong run_image_kernel(const cl::CommandQueue& queue, const cl::Program& program, const string& kernel_name, const cl::Image2D& input, const cl::Image2D& output,
+	const cl::Buffer& mask, int width, int height)
+{
+	cl::Kernel kernel(program, kernel_name.c_str());
+	cl::Event kernel_event;
+
+	kernel.setArg(0, input);
+	kernel.setArg(1, output);
+
+	if (kernel_name == "convolution_image")
+		kernel.setArg(2, mask);
+
+	queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(width, height), cl::NullRange, NULL, &kernel_event);
+	kernel_event.wait();
+
+	return get_event_time(kernel_event);
+} // end function run_image_kernel
+
+/*
+benchmark the image object kernels against the buffer kernels with the same mask;
+the upload time of each memory object is measured once, and each kernel time is the minimum of 3 runs
+*/
+void benchmark_image_kernels(const cl::Context& context, const cl::CommandQueue& queue, const cl::Program& program, const CImg<unsigned char>& image, const cl::Buffer& mask, int mask_size)
+{
+	int width = image.width();
+	int height = image.height();
+	std::vector<unsigned char> rgba = get_rgba_image(image);
+	cl::Buffer dev_input(context, CL_MEM_READ_ONLY, image.size());
+	cl::Buffer dev_output(context, CL_MEM_READ_WRITE, image.size());
+	cl::Image2D dev_image_input(context, CL_MEM_READ_ONLY, cl::ImageFormat(CL_RGBA, CL_UNORM_INT8), width, height);
+	cl::Image2D dev_image_output(context, CL_MEM_WRITE_ONLY, cl::ImageFormat(CL_RGBA, CL_UNORM_INT8), width, height);
+	cl::Event buffer_event, image_event;
+	std::array<cl::size_type, 3> origin = { 0, 0, 0 };
+	std::array<cl::size_type, 3> region = { (cl::size_type)width, (cl::size_type)height, 1 };
+
+	queue.enqueueWriteBuffer(dev_input, CL_TRUE, 0, image.size(), image.data(), NULL, &buffer_event);
+	queue.enqueueWriteImage(dev_image_input, CL_TRUE, origin, region, 0, 0, &rgba[0], NULL, &image_event);
+
+	std::cout << "Upload time (unit: ns): buffer " << get_event_time(buffer_event) << ", image " << get_event_time(image_event) << std::endl;
+
+	const string buffer_kernels[] = { "identityND", "avg_filterND", "convolution_tiled" };
+	const string image_kernels[] = { "identity_image", "avg_filter_image", "convolution_image" };
+
+	for (int k = 0; k < 3; k++)
+	{
+		cl_ulong buffer_time = 0, image_time = 0;
+
+		for (int i = 0; i < 3; i++)
+		{
+			cl_ulong time;
+
+			if (buffer_kernels[k] == "convolution_tiled")
+				time = run_convolution_tiled(queue, program, dev_input, dev_output, mask, width, height, image.spectrum(), mask_size);
+			else
+			{
+				cl::Kernel kernel(program, buffer_kernels[k].c_str());
+
+				kernel.setArg(0, dev_input);
+				kernel.setArg(1, dev_output);
+				queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(width, height, image.spectrum()), cl::NullRange, NULL, &buffer_event);
+				buffer_event.wait();
+				time = get_event_time(buffer_event);
+			} // end if...else
+
+			buffer_time = i ? std::min(buffer_time, time) : time;
+
+			time = run_image_kernel(queue, program, image_kernels[k], dev_image_input, dev_image_output, mask, width, height);
+			image_time = i ? std::min(image_time, time) : time;
+		} // end for
+
+		std::cout << buffer_kernels[k] << " vs " << image_kernels[k] << " (unit: ns): " << buffer_time << ", " << image_time << std::endl;
+	} // end for
+} // end function benchmark_image_kernels
+
+/*
+run a chain of operations with one kernel per operation and return the total execution time in nanoseconds (for comparison with a fused kernel);
+the image goes through global memory between operations, alternating between "output" and "temporary"
+*/
+cl_ulong run_unfused_chain(const cl::CommandQueue& queue, const cl::Program& program, const std::vector<string>& chain, const cl::Buffer& input, const cl::Buffer& temporary,
+	const cl::Buffer& output, const cl::Buffer& mask, int width, int height, int spectrum, int mask_size)
+{
+	cl_ulong time = 0;
+	const cl::Buffer* source = &input;
+
+	for (size_t i = 0; i < chain.size(); i++)
+	{
+		const cl::Buffer* destination = (chain.size() - i) % 2 ? &output : &temporary; // the last operation writes to "output"
+
+		if (chain[i] == "convolution")
+			time += run_convolution_tiled(queue, program, *source, *destination, mask, width, height, spectrum, mask_size);
+		else
+		{
+			cl::Kernel kernel(program, chain[i].c_str());
+			cl::Event kernel_event;
+
+			kernel.setArg(0, *source);
+			kernel.setArg(1, *destination);
+			queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(width * height * spectrum), cl::NullRange, NULL, &kernel_event);
+			kernel_event.wait();
+			time += get_event_time(kernel_event);
+		} // end if...else
+
+		source = destination;
+	} // end for
+
+	return time;
+} // end function run_unfused_chain
+
+/*
+benchmark the tiled and separable convolution kernels with Gaussian masks of radius 1 to 25;
+the cost per pixel is O(r^2) for the tiled kernel and O(r) for the separable kernels, and the crossover point is the smallest radius where the separable kernels are faster;
+each time is the minimum of 3 runs
+*/
+void benchmark_convolution(const cl::Context& context, const cl::CommandQueue& queue, const cl::Buffer& input, int width, int height, int spectrum, int boundary_mode)
+{
+	cl::Buffer output(context, CL_MEM_READ_WRITE, (size_t)width * height * spectrum);
+	cl::Buffer intermediate(context, CL_MEM_READ_WRITE, (size_t)width * height * spectrum * sizeof(float));
+	int crossover = 0;
+
+	for (int mask_size = 3; mask_size <= 51; mask_size += 2)
+	{
+		cl::Program program = build_program(context, mask_size, boundary_mode);
+		std::vector<float> mask = get_gaussian_mask(mask_size), row, column;
+
+		get_separable_mask(mask, mask_size, row, column);
+
+		cl::Buffer dev_mask(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, mask.size() * sizeof(float), &mask[0]);
+		cl::Buffer dev_row_mask(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, row.size() * sizeof(float), &row[0]);
+		cl::Buffer dev_column_mask(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, column.size() * sizeof(float), &column[0]);
+		cl_ulong tiled_time = 0, separable_time = 0;
+
+		for (int i = 0; i < 3; i++)
+		{
+			cl_ulong time = run_convolution_tiled(queue, program, input, output, dev_mask, width, height, spectrum, mask_size);
+			tiled_time = i ? std::min(tiled_time, time) : time;
+
+			time = run_convolution_separable(queue, program, input, intermediate, output, dev_row_mask, dev_column_mask, width, height, spectrum, mask_size);
+			separable_time = i ? std::min(separable_time, time) : time;
+		} // end for
+
+		if (!crossover && separable_time < tiled_time)
+			crossover = mask_size / 2;
+
+		std::cout << "Radius " << mask_size / 2 << " (unit: ns): tiled " << tiled_time << ", separable " << separable_time << std::endl;
+	} // end for
+
+	if (crossover)
+		std::cout << "The separable kernels are faster from radius " << crossover << std::endl;
+	else
+		std::cout << "The separable kernels are not faster for any radius tested" << std::endl;
+} // end function benchmark_convolution
+
 int main(int argc, char **argv)
 {
 	// Part 1 - handle command line options such as device selection, verbosity, etc.
 	int platform_id = 0;
 	int device_id = 0;
 	string image_filename = "test.ppm";
+	string kernel_name = "convolution_tiled";
+	int mask_size = 3;
+	int boundary_mode = 0;
+	bool benchmark = false;
+	bool image_benchmark = false;
+	std::vector<string> chain; // operations of a fused chain
 
 	for (int i = 1; i < argc; i++)
 	{
@@ -37,6 +464,24 @@ int main(int argc, char **argv)
 			std::cout << ListPlatformsDevices() << std::endl;
 		else if ((strcmp(argv[i], "-f") == 0) && (i < (argc - 1)))
 			image_filename = argv[++i];
+		else if ((strcmp(argv[i], "-k") == 0) && (i < (argc - 1)))
+			kernel_name = argv[++i];
+		else if ((strcmp(argv[i], "-m") == 0) && (i < (argc - 1)))
+			mask_size = atoi(argv[++i]);
+		else if ((strcmp(argv[i], "-b") == 0) && (i < (argc - 1)))
+			boundary_mode = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-x") == 0)
+			benchmark = true;
+		else if (strcmp(argv[i], "-i") == 0)
+			image_benchmark = true;
+		else if ((strcmp(argv[i], "-c") == 0) && (i < (argc - 1)))
+		{
+			stringstream operations(argv[++i]);
+			string operation;
+
+			while (std::getline(operations, operation, ','))
+				chain.push_back(operation);
+		}
 		else if (strcmp(argv[i], "-h") == 0)
 		{
 			print_help();
@@ -44,6 +489,18 @@ int main(int argc, char **argv)
 		} // end nested if...else
 	} // end for
 
+	if (mask_size < 1 || mask_size % 2 == 0)
+	{
+		std::cerr << "ERROR: The mask size should be a positive odd number." << std::endl;
+		return 0;
+	} // end if
+
+	if (boundary_mode < 0 || boundary_mode > 2)
+	{
+		std::cerr << "ERROR: Inexistent boundary mode." << std::endl;
+		return 0;
+	} // end if
+
 	string image_path = "images\\" + image_filename;
 
 	cimg::exception_mode(0);
@@ -63,38 +520,45 @@ int main(int argc, char **argv)
 												2.f / 16, 4.f / 16, 2.f / 16,
 												1.f / 16, 2.f / 16, 1.f / 16 };
 
+		// kernels "convolution_tiled", "convolution_separable", and "convolution_image" support Gaussian masks of any odd size
+		if (kernel_name == "convolution_tiled" || kernel_name == "convolution_separable" || kernel_name == "convolution_image" || image_benchmark || !chain.empty())
+			convolution_mask = get_gaussian_mask(mask_size);
+
+		std::vector<float> row_mask, column_mask;
+
+		// a mask which is not rank-1 falls back to the tiled 2D kernel
+		if (kernel_name == "convolution_separable" && !get_separable_mask(convolution_mask, mask_size, row_mask, column_mask))
+		{
+			std::cout << "The mask is not separable, using kernel \"convolution_tiled\" instead" << std::endl;
+			kernel_name = "convolution_tiled";
+		} // end if
+
 		// Part 3 - host operations
 		// 3.1 Select computing devices
 		cl::Context context = GetContext(platform_id, device_id);
 
 		std::cout << "Running on " << GetPlatformName(platform_id) << ", " << GetDeviceName(platform_id, device_id) << std::endl; // display the selected device
 
-		cl::CommandQueue queue(context); // create a queue to which we will push commands for the device
+		cl::CommandQueue queue(context, CL_QUEUE_PROFILING_ENABLE); // create a queue to which we will push commands for the device and enable profiling for the queue
 
 		// 3.2 Load & build the device code
-		cl::Program::Sources sources;
-
-		AddSources(sources, "kernels/my_kernels.cl");
+		cl::Program program = build_program(context, mask_size, boundary_mode);
+		FusedProgramCache program_cache(context); // programs generated for fused chains, shared by every pipeline on the context
 
-		cl::Program program(context, sources);
+		// Part 4 - device operations
+		// the packed greyscale conversion writes a single channel, so downstream stages process a third of the data
+		int output_spectrum = (chain.empty() && kernel_name == "rgb2grey_packed") ? 1 : image_input.spectrum();
+		size_t output_size = (size_t)image_input.width() * image_input.height() * output_spectrum;
 
-		// build and debug the kernel code
-		try
-		{ 
-			program.build();
-		}
-		catch (const cl::Error& err)
+		if (output_spectrum == 1 && image_input.spectrum() != 3)
 		{
-			std::cout << "Build Status: " << program.getBuildInfo<CL_PROGRAM_BUILD_STATUS>(context.getInfo<CL_CONTEXT_DEVICES>()[0]) << std::endl;
-			std::cout << "Build Options:\t" << program.getBuildInfo<CL_PROGRAM_BUILD_OPTIONS>(context.getInfo<CL_CONTEXT_DEVICES>()[0]) << std::endl;
-			std::cout << "Build Log:\t " << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(context.getInfo<CL_CONTEXT_DEVICES>()[0]) << std::endl;
-			throw err;
-		} // end try...catch
+			std::cerr << "ERROR: Kernel \"rgb2grey_packed\" requires a colour image." << std::endl;
+			return 0;
+		} // end if
 
-		// Part 4 - device operations
 		// device - buffers
 		cl::Buffer dev_image_input(context, CL_MEM_READ_ONLY, image_input.size());
-		cl::Buffer dev_image_output(context, CL_MEM_READ_WRITE, image_input.size()); // it should be the same as input image
+		cl::Buffer dev_image_output(context, CL_MEM_READ_WRITE, output_size); // it should be the same as input image unless the output has a single channel
 		cl::Buffer dev_convolution_mask(context, CL_MEM_READ_ONLY, convolution_mask.size() * sizeof(float)); // uncomment this in Section 3.2.2
 
 		// 4.1 Copy images to device memory
@@ -102,26 +566,146 @@ int main(int argc, char **argv)
 		queue.enqueueWriteBuffer(dev_convolution_mask, CL_TRUE, 0, convolution_mask.size() * sizeof(float), &convolution_mask[0]); // uncomment this in Section 3.2.2
 
 		// 4.2 Setup and execute the kernel (i.e. device code)
-		// cl::Kernel kernel = cl::Kernel(program, "identity"); // a simple 1D identity kernel that copies all pixels from A to B (original code of Section 2)
-		// cl::Kernel kernel = cl::Kernel(program, "filter_r"); // perform colour channel filtering (Task4U-1 of Section 2)
-		// cl::Kernel kernel = cl::Kernel(program, "invert"); // invert the intensity value of each pixel (Task4U-2 of Section 2)
-		// cl::Kernel kernel = cl::Kernel(program, "rgb2grey"); // convert an input colour image into greyscale (Task4U-4 of Section 2)
-		// cl::Kernel kernel = cl::Kernel(program, "identityND"); // a simple ND identity kernel (Section 3.2)
-		// cl::Kernel kernel = cl::Kernel(program, "avg_filterND"); // a 2D averaging filter (Section 3.2)
-		cl::Kernel kernel = cl::Kernel(program, "convolutionND"); // a 2D 3x3 convolution kernel (Section 3.2.2)
-		kernel.setArg(0, dev_image_input);
-		kernel.setArg(1, dev_image_output);
-		kernel.setArg(2, dev_convolution_mask); // uncomment this in Section 3.2.2
-
-		// queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(image_input.size()), cl::NullRange);
-		queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(image_input.width(), image_input.height(), image_input.spectrum()), cl::NullRange); // run a kernel in a 3D arrangement with image width, height, spectrum (colour channel) specifying values for 3 dimensions (Section 3.2, including Sections 3.2.1 & 3.2.2)
-
-		vector<unsigned char> output_buffer(image_input.size());
-
-		// 4.3 Copy the result from device to host
-		queue.enqueueReadBuffer(dev_image_output, CL_TRUE, 0, output_buffer.size(), &output_buffer.data()[0]);
-
-		CImg<unsigned char> output_image(output_buffer.data(), image_input.width(), image_input.height(), image_input.depth(), image_input.spectrum());
+		/*
+		available kernels:
+		"identity" - a simple 1D identity kernel that copies all pixels from A to B (original code of Section 2);
+		"filter_r" - perform colour channel filtering (Task4U-1 of Section 2);
+		"invert" - invert the intensity value of each pixel (Task4U-2 of Section 2);
+		"rgb2grey" - convert an input colour image into greyscale (Task4U-4 of Section 2);
+		"rgb2grey_packed" - convert an input colour image into a single-channel greyscale image with one work item per pixel;
+		"identityND" - a simple ND identity kernel (Section 3.2);
+		"avg_filterND" - a 2D averaging filter (Section 3.2);
+		"convolutionND" - a 2D 3x3 convolution kernel (Section 3.2.2);
+		"convolution_tiled" - a 2D convolution kernel of any odd mask size using local memory tiles;
+		"convolution_separable" - a horizontal pass and a vertical pass of a separable mask of any odd size using local memory tiles;
+		"identity_image", "avg_filter_image", and "convolution_image" - variants of "identityND", "avg_filterND", and "convolution_tiled" reading image objects through a sampler;
+		"median_filter" - a 2D median filter for small windows using local memory tiles and sorting networks;
+		"median_filter_histogram" - a 2D median filter of any radius using histograms
+		*/
+		cl_ulong kernel_time = 0; // kernel execution time in nanoseconds
+
+		// the sorting networks of kernel "median_filter" grow quadratically with the window size
+		if (kernel_name == "median_filter" && mask_size > 5)
+		{
+			std::cout << "The window is too large for sorting networks, using kernel \"median_filter_histogram\" instead" << std::endl;
+			kernel_name = "median_filter_histogram";
+		} // end if
+
+		bool image_kernel = kernel_name == "identity_image" || kernel_name == "avg_filter_image" || kernel_name == "convolution_image";
+		vector<unsigned char> output_buffer(output_size);
+
+		if ((image_kernel || image_benchmark) && !context.getInfo<CL_CONTEXT_DEVICES>()[0].getInfo<CL_DEVICE_IMAGE_SUPPORT>())
+		{
+			std::cerr << "ERROR: The selected device does not support image objects." << std::endl;
+			return 0;
+		} // end if
+
+		if (!chain.empty())
+		{
+			FusedPipeline pipeline(program_cache, queue, boundary_mode); // the same boundary mode as the program of the unfused chain
+			cl::Buffer dev_image_temporary(context, CL_MEM_READ_WRITE, image_input.size()); // an intermediate image for the unfused chain only
+
+			std::cout << "Fusing " << chain.size() << " operations into a single kernel" << std::endl;
+
+			for (const string& operation : chain)
+			{
+				if (operation == "filter_r")
+					pipeline.FilterR();
+				else if (operation == "invert")
+					pipeline.Invert();
+				else if (operation == "rgb2grey")
+					pipeline.Rgb2Grey();
+				else if (operation == "convolution")
+					pipeline.Convolve(convolution_mask, mask_size);
+				else
+				{
+					std::cerr << "ERROR: Inexistent operation \"" << operation << "\"." << std::endl;
+					return 0;
+				} // end nested if...else
+			} // end for
+
+			std::cout << "Unfused kernel execution time (unit: ns): "
+				<< run_unfused_chain(queue, program, chain, dev_image_input, dev_image_temporary, dev_image_output, dev_convolution_mask, image_input.width(), image_input.height(), image_input.spectrum(), mask_size) << std::endl;
+
+			kernel_time = pipeline.Run(dev_image_input, dev_image_output, image_input.width(), image_input.height(), image_input.spectrum());
+		}
+		else if (image_kernel)
+		{
+			std::vector<unsigned char> rgba = get_rgba_image(image_input);
+			cl::Image2D dev_image_input_2d(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, cl::ImageFormat(CL_RGBA, CL_UNORM_INT8), image_input.width(), image_input.height(), 0, &rgba[0]);
+			cl::Image2D dev_image_output_2d(context, CL_MEM_WRITE_ONLY, cl::ImageFormat(CL_RGBA, CL_UNORM_INT8), image_input.width(), image_input.height());
+			std::array<cl::size_type, 3> origin = { 0, 0, 0 };
+			std::array<cl::size_type, 3> region = { (cl::size_type)image_input.width(), (cl::size_type)image_input.height(), 1 };
+
+			kernel_time = run_image_kernel(queue, program, kernel_name, dev_image_input_2d, dev_image_output_2d, dev_convolution_mask, image_input.width(), image_input.height());
+
+			queue.enqueueReadImage(dev_image_output_2d, CL_TRUE, origin, region, 0, 0, &rgba[0]);
+			get_planar_image(rgba, output_buffer, image_input.width(), image_input.height(), image_input.spectrum());
+		}
+		else if (kernel_name == "median_filter")
+		{
+			std::cout << "Using " << mask_size << "x" << mask_size << " window" << std::endl;
+
+			kernel_time = run_median_filter(queue, program, dev_image_input, dev_image_output, image_input.width(), image_input.height(), image_input.spectrum(), mask_size);
+		}
+		else if (kernel_name == "median_filter_histogram")
+		{
+			std::cout << "Using " << mask_size << "x" << mask_size << " window" << std::endl;
+
+			kernel_time = run_median_filter_histogram(context, queue, program, dev_image_input, dev_image_output, image_input.width(), image_input.height(), image_input.spectrum(), mask_size);
+		}
+		else if (kernel_name == "convolution_tiled")
+		{
+			std::cout << "Using " << mask_size << "x" << mask_size << " mask" << std::endl;
+
+			kernel_time = run_convolution_tiled(queue, program, dev_image_input, dev_image_output, dev_convolution_mask, image_input.width(), image_input.height(), image_input.spectrum(), mask_size);
+		}
+		else if (kernel_name == "convolution_separable")
+		{
+			std::cout << "Using " << mask_size << "x" << mask_size << " mask in 2 passes" << std::endl;
+
+			cl::Buffer dev_image_intermediate(context, CL_MEM_READ_WRITE, image_input.size() * sizeof(float)); // the float intermediate image avoids rounding twice
+			cl::Buffer dev_row_mask(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, row_mask.size() * sizeof(float), &row_mask[0]);
+			cl::Buffer dev_column_mask(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, column_mask.size() * sizeof(float), &column_mask[0]);
+
+			kernel_time = run_convolution_separable(queue, program, dev_image_input, dev_image_intermediate, dev_image_output, dev_row_mask, dev_column_mask,
+				image_input.width(), image_input.height(), image_input.spectrum(), mask_size);
+		}
+		else
+		{
+			cl::Kernel kernel = cl::Kernel(program, kernel_name.c_str());
+			cl::Event kernel_event; // add an additional event to measure the kernel execution time
+
+			kernel.setArg(0, dev_image_input);
+			kernel.setArg(1, dev_image_output);
+
+			if (kernel_name == "convolutionND")
+				kernel.setArg(2, dev_convolution_mask); // uncomment this in Section 3.2.2
+
+			if (kernel_name == "rgb2grey_packed")
+				queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(image_input.width(), image_input.height()), cl::NullRange, NULL, &kernel_event);
+			else if (kernel_name == "identityND" || kernel_name == "avg_filterND" || kernel_name == "convolutionND")
+				queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(image_input.width(), image_input.height(), image_input.spectrum()), cl::NullRange, NULL, &kernel_event); // run a kernel in a 3D arrangement with image width, height, spectrum (colour channel) specifying values for 3 dimensions (Section 3.2, including Sections 3.2.1 & 3.2.2)
+			else
+				queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(image_input.size()), cl::NullRange, NULL, &kernel_event);
+
+			kernel_event.wait();
+			kernel_time = get_event_time(kernel_event);
+		} // end if...else
+
+		// 4.3 Copy the result from device to host (the result of an image object kernel has been copied)
+		if (!image_kernel)
+			queue.enqueueReadBuffer(dev_image_output, CL_TRUE, 0, output_buffer.size(), &output_buffer.data()[0]);
+
+		std::cout << "Kernel execution time (unit: ns): " << kernel_time << std::endl;
+
+		if (benchmark)
+			benchmark_convolution(context, queue, dev_image_input, image_input.width(), image_input.height(), image_input.spectrum(), boundary_mode);
+
+		if (image_benchmark)
+			benchmark_image_kernels(context, queue, program, image_input, dev_convolution_mask, mask_size);
+
+		CImg<unsigned char> output_image(output_buffer.data(), image_input.width(), image_input.height(), image_input.depth(), output_spectrum);
 		CImgDisplay disp_output(output_image, "output");
 
 		while (!disp_input.is_closed() && !disp_output.is_closed()
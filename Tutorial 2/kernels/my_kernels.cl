@@ -1,3 +1,41 @@
+/*
+the following macros configure the tiled convolution and median filter kernels and are normally set via build options, e.g. "-DMASK_SIZE=5 -DBOUNDARY_MODE=1";
+the mask size (or window size of a median filter) must be odd
+*/
+#ifndef MASK_SIZE
+#define MASK_SIZE 3
+#endif
+
+#define MASK_RADIUS (MASK_SIZE / 2)
+
+// boundary modes: 0 - clamp to the edge pixel, 1 - mirror without repeating the edge pixel, 2 - zero padding
+#define BOUNDARY_CLAMP 0
+#define BOUNDARY_MIRROR 1
+#define BOUNDARY_ZERO 2
+
+#ifndef BOUNDARY_MODE
+#define BOUNDARY_MODE BOUNDARY_CLAMP
+#endif
+
+// map a coordinate which may be outside an image back into the image according to the boundary mode (-1 means a zero pixel)
+int get_boundary_index(int i, int size)
+{
+#if BOUNDARY_MODE == BOUNDARY_MIRROR
+	if (size == 1)
+		return 0;
+
+	// reflect repeatedly in case the mask radius exceeds the image size
+	while (i < 0 || i >= size)
+		i = i < 0 ? -i : 2 * (size - 1) - i;
+
+	return i;
+#elif BOUNDARY_MODE == BOUNDARY_ZERO
+	return (i < 0 || i >= size) ? -1 : i;
+#else
+	return clamp(i, 0, size - 1);
+#endif
+} // end function get_boundary_index
+
 // a simple OpenCL kernel which copies all pixels from A to B
 kernel void identity(global const uchar* A, global uchar* B)
 {
@@ -49,6 +87,19 @@ kernel void rgb2grey(global const uchar* A, global uchar* B)
 	} // end if
 } // end function rgb2grey
 
+/*
+convert an input colour image into a single-channel greyscale image with one work item per pixel in a 2D arrangement;
+unlike "rgb2grey", no work item is idle, float coefficients are used, and the output is a third of the input size
+*/
+kernel void rgb2grey_packed(global const uchar* A, global uchar* B)
+{
+	int width = get_global_size(0); // image width in pixels
+	int image_size = width * get_global_size(1); // image size in pixels
+	int id = get_global_id(0) + get_global_id(1) * width;
+
+	B[id] = convert_uchar_sat_rte(0.2126f * A[id] + 0.7152f * A[id + image_size] + 0.0722f * A[id + image_size * 2]);
+} // end function rgb2grey_packed
+
 // a simple ND identity kernel
 kernel void identityND(global const uchar* A, global uchar* B)
 {
@@ -96,6 +147,159 @@ kernel void avg_filterND(global const uchar* A, global uchar* B)
 	B[id] = (uchar)result;
 } // end function avg_filterND
 
+// sort a pair of values without a branch so that "a" is not greater than "b"
+#define SORT_PAIR(a, b) { uchar smaller = min(a, b); b = max(a, b); a = smaller; }
+
+// get the median of 9 values with a sorting network of 19 compare-exchange operations
+uchar get_median_9(uchar* p)
+{
+	SORT_PAIR(p[1], p[2]); SORT_PAIR(p[4], p[5]); SORT_PAIR(p[7], p[8]);
+	SORT_PAIR(p[0], p[1]); SORT_PAIR(p[3], p[4]); SORT_PAIR(p[6], p[7]);
+	SORT_PAIR(p[1], p[2]); SORT_PAIR(p[4], p[5]); SORT_PAIR(p[7], p[8]);
+	SORT_PAIR(p[0], p[3]); SORT_PAIR(p[5], p[8]); SORT_PAIR(p[4], p[7]);
+	SORT_PAIR(p[3], p[6]); SORT_PAIR(p[1], p[4]); SORT_PAIR(p[2], p[5]);
+	SORT_PAIR(p[4], p[7]); SORT_PAIR(p[4], p[2]); SORT_PAIR(p[6], p[4]);
+	SORT_PAIR(p[4], p[2]);
+
+	return p[4];
+} // end function get_median_9
+
+/*
+a 2D median filter for an odd window size fixed at build time (MASK_SIZE), using local memory tiles and branch-free sorting networks;
+each work group loads its tile plus a halo of MASK_RADIUS pixels into local memory once (the boundary mode is the same as that of the tiled convolution kernel);
+a 3x3 window uses an optimal median network, and other sizes use an odd-even transposition network which is fully unrolled as its size is known at build time;
+it is only built for small windows (3x3 and 5x5) to keep the unrolled networks small, and "median_filter_histogram" covers larger radii;
+"tile" should hold (local width + MASK_SIZE - 1) * (local height + MASK_SIZE - 1) elements
+*/
+#if MASK_SIZE <= 5
+kernel void median_filter(global const uchar* A, global uchar* B, local uchar* tile, const int width, const int height)
+{
+	int x = get_global_id(0); // current x coordinate
+	int y = get_global_id(1); // current y coordinate
+	int c = get_global_id(2); // current colour channel
+	int lx = get_local_id(0);
+	int ly = get_local_id(1);
+	int local_width = get_local_size(0);
+	int local_height = get_local_size(1);
+	int tile_width = local_width + 2 * MASK_RADIUS;
+	int tile_height = local_height + 2 * MASK_RADIUS;
+	int origin_x = get_group_id(0) * local_width - MASK_RADIUS; // x coordinate of the top left corner of the tile including the halo
+	int origin_y = get_group_id(1) * local_height - MASK_RADIUS; // y coordinate of the top left corner of the tile including the halo
+	global const uchar* channel = A + c * width * height;
+
+	// the tile is larger than the work group, so each work item loads several pixels with strides of the work group size
+	for (int j = ly; j < tile_height; j += local_height)
+		for (int i = lx; i < tile_width; i += local_width)
+		{
+			int global_x = get_boundary_index(origin_x + i, width);
+			int global_y = get_boundary_index(origin_y + j, height);
+
+			tile[i + j * tile_width] = (global_x < 0 || global_y < 0) ? 0 : channel[global_x + global_y * width];
+		} // end for
+
+	barrier(CLK_LOCAL_MEM_FENCE); // wait for all local threads to finish loading the tile
+
+	if (x < width && y < height)
+	{
+		uchar window[MASK_SIZE * MASK_SIZE];
+
+		for (int j = 0; j < MASK_SIZE; j++)
+			for (int i = 0; i < MASK_SIZE; i++)
+				window[i + j * MASK_SIZE] = tile[lx + i + (ly + j) * tile_width];
+
+#if MASK_SIZE == 3
+		B[x + y * width + c * width * height] = get_median_9(window);
+#else
+#pragma unroll
+		for (int round = 0; round < MASK_SIZE * MASK_SIZE; round++)
+#pragma unroll
+			for (int i = round & 1; i + 1 < MASK_SIZE * MASK_SIZE; i += 2)
+				SORT_PAIR(window[i], window[i + 1]);
+
+		B[x + y * width + c * width * height] = window[MASK_SIZE * MASK_SIZE / 2];
+#endif
+	} // end if
+} // end function median_filter
+#endif
+
+/*
+a 2D median filter of any radius using histograms (constant time per pixel with respect to the radius);
+each work item filters a vertical strip of "strip_width" columns in a colour channel from top to bottom:
+it keeps a 256-bin histogram for each column of the strip plus a halo of "radius" columns on each side, and moving down a row updates each column histogram with 2 pixels;
+the window histogram of the first pixel in a row is the sum of 2 * radius + 1 column histograms, and moving right adds a column histogram and subtracts another;
+coordinates outside the image are clamped to the edge;
+"histograms" should hold (strip_width + 2 * radius + 1) * 256 elements for each work item, where the extra histogram is the window histogram
+*/
+kernel void median_filter_histogram(global const uchar* A, global uchar* B, global uint* histograms, const int width, const int height, const int radius, const int strip_width)
+{
+	int strip = get_global_id(0); // current strip
+	int c = get_global_id(1); // current colour channel
+	int x0 = strip * strip_width; // the first column of the strip
+	int x1 = min(x0 + strip_width, width); // the column after the last column of the strip
+	int column_count = x1 - x0 + 2 * radius; // the number of column histograms including the halo
+	int median_rank = (2 * radius + 1) * (2 * radius + 1) / 2 + 1; // the median is the value whose cumulative count first reaches this rank
+	global const uchar* channel = A + c * width * height;
+	global uint* column_histograms = histograms + (strip + c * get_global_size(0)) * (strip_width + 2 * radius + 1) * 256;
+	global uint* window_histogram = column_histograms + (strip_width + 2 * radius) * 256;
+
+	if (x0 >= width)
+		return;
+
+	// initialise the column histograms with the window rows of the first row
+	for (int k = 0; k < column_count * 256; k++)
+		column_histograms[k] = 0;
+
+	for (int k = 0; k < column_count; k++)
+	{
+		int column = clamp(x0 - radius + k, 0, width - 1);
+
+		for (int j = -radius; j <= radius; j++)
+			column_histograms[k * 256 + channel[column + clamp(j, 0, height - 1) * width]]++;
+	} // end for
+
+	for (int y = 0; y < height; y++)
+	{
+		// move the column histograms down a row
+		if (y > 0)
+			for (int k = 0; k < column_count; k++)
+			{
+				int column = clamp(x0 - radius + k, 0, width - 1);
+
+				column_histograms[k * 256 + channel[column + max(y - radius - 1, 0) * width]]--;
+				column_histograms[k * 256 + channel[column + min(y + radius, height - 1) * width]]++;
+			} // end for
+
+		// the window histogram of the first pixel in the row
+		for (int v = 0; v < 256; v++)
+		{
+			uint count = 0;
+
+			for (int k = 0; k <= 2 * radius; k++)
+				count += column_histograms[k * 256 + v];
+
+			window_histogram[v] = count;
+		} // end for
+
+		for (int x = x0; x < x1; x++)
+		{
+			int k = x - x0;
+
+			// move the window right by a column
+			if (x > x0)
+				for (int v = 0; v < 256; v++)
+					window_histogram[v] += column_histograms[(k + 2 * radius) * 256 + v] - column_histograms[(k - 1) * 256 + v];
+
+			uint cumulative_count = 0;
+			int median = 0;
+
+			while ((cumulative_count += window_histogram[median]) < median_rank)
+				median++;
+
+			B[x + y * width + c * width * height] = median;
+		} // end for
+	} // end for
+} // end function median_filter_histogram
+
 // a 2D 3x3 convolution kernel
 kernel void convolutionND(global const uchar* A, global uchar* B, constant float* mask)
 {
@@ -117,7 +321,173 @@ kernel void convolutionND(global const uchar* A, global uchar* B, constant float
 	else
 		for (int i = x - 1; i <= x + 1; i++)
 			for (int j = y - 1; j <= y + 1; j++) 
-				result += A[i + j * width + c * image_size] * mask[i - (x - 1) + j - (y - 1)];
+				result += A[i + j * width + c * image_size] * mask[i - (x - 1) + (j - (y - 1)) * 3]; // the mask is stored row by row
 
 	B[id] = (uchar)result;
-} // end function convolutionND
\ No newline at end of file
+} // end function convolutionND
+
+/*
+a 2D convolution kernel for an odd mask size fixed at build time (MASK_SIZE), using local memory tiles;
+each work group loads its tile plus a halo of MASK_RADIUS pixels into local memory once, so each input pixel is read from global memory about once per work group instead of MASK_SIZE * MASK_SIZE times;
+the global size may be padded to a multiple of the work group size, so the image width and height are passed as arguments;
+"tile" should hold (local width + MASK_SIZE - 1) * (local height + MASK_SIZE - 1) elements
+*/
+kernel void convolution_tiled(global const uchar* A, global uchar* B, constant float* mask, local float* tile, const int width, const int height)
+{
+	int x = get_global_id(0); // current x coordinate
+	int y = get_global_id(1); // current y coordinate
+	int c = get_global_id(2); // current colour channel
+	int lx = get_local_id(0);
+	int ly = get_local_id(1);
+	int local_width = get_local_size(0);
+	int local_height = get_local_size(1);
+	int tile_width = local_width + 2 * MASK_RADIUS;
+	int tile_height = local_height + 2 * MASK_RADIUS;
+	int origin_x = get_group_id(0) * local_width - MASK_RADIUS; // x coordinate of the top left corner of the tile including the halo
+	int origin_y = get_group_id(1) * local_height - MASK_RADIUS; // y coordinate of the top left corner of the tile including the halo
+	global const uchar* channel = A + c * width * height;
+
+	// the tile is larger than the work group, so each work item loads several pixels with strides of the work group size
+	for (int j = ly; j < tile_height; j += local_height)
+		for (int i = lx; i < tile_width; i += local_width)
+		{
+			int global_x = get_boundary_index(origin_x + i, width);
+			int global_y = get_boundary_index(origin_y + j, height);
+
+			tile[i + j * tile_width] = (global_x < 0 || global_y < 0) ? 0 : channel[global_x + global_y * width];
+		} // end for
+
+	barrier(CLK_LOCAL_MEM_FENCE); // wait for all local threads to finish loading the tile
+
+	if (x < width && y < height)
+	{
+		float result = 0;
+
+		for (int j = 0; j < MASK_SIZE; j++)
+			for (int i = 0; i < MASK_SIZE; i++)
+				result += tile[lx + i + (ly + j) * tile_width] * mask[i + j * MASK_SIZE];
+
+		B[x + y * width + c * width * height] = convert_uchar_sat_rte(result);
+	} // end if
+} // end function convolution_tiled
+
+/*
+the horizontal pass of a separable convolution for an odd mask size fixed at build time (MASK_SIZE), using local memory tiles;
+each work group loads its rows plus a horizontal halo of MASK_RADIUS pixels into local memory once;
+the result is kept in a float intermediate buffer so that it is rounded only once after the vertical pass;
+"tile" should hold (local width + MASK_SIZE - 1) * local height elements
+*/
+kernel void convolution_rows(global const uchar* A, global float* B, constant float* mask, local float* tile, const int width, const int height)
+{
+	int x = get_global_id(0); // current x coordinate
+	int y = get_global_id(1); // current y coordinate
+	int c = get_global_id(2); // current colour channel
+	int lx = get_local_id(0);
+	int ly = get_local_id(1);
+	int local_width = get_local_size(0);
+	int tile_width = local_width + 2 * MASK_RADIUS;
+	int origin_x = get_group_id(0) * local_width - MASK_RADIUS; // x coordinate of the left end of the tile including the halo
+	int row = min(y, height - 1); // padding work items load a valid row
+	global const uchar* channel = A + c * width * height;
+
+	for (int i = lx; i < tile_width; i += local_width)
+	{
+		int global_x = get_boundary_index(origin_x + i, width);
+
+		tile[i + ly * tile_width] = global_x < 0 ? 0 : channel[global_x + row * width];
+	} // end for
+
+	barrier(CLK_LOCAL_MEM_FENCE); // wait for all local threads to finish loading the tile
+
+	if (x < width && y < height)
+	{
+		float result = 0;
+
+		for (int i = 0; i < MASK_SIZE; i++)
+			result += tile[lx + i + ly * tile_width] * mask[i];
+
+		B[x + y * width + c * width * height] = result;
+	} // end if
+} // end function convolution_rows
+
+/*
+the vertical pass of a separable convolution for an odd mask size fixed at build time (MASK_SIZE), using local memory tiles;
+each work group loads its columns of the float intermediate buffer plus a vertical halo of MASK_RADIUS pixels into local memory once;
+"tile" should hold local width * (local height + MASK_SIZE - 1) elements
+*/
+kernel void convolution_columns(global const float* A, global uchar* B, constant float* mask, local float* tile, const int width, const int height)
+{
+	int x = get_global_id(0); // current x coordinate
+	int y = get_global_id(1); // current y coordinate
+	int c = get_global_id(2); // current colour channel
+	int lx = get_local_id(0);
+	int ly = get_local_id(1);
+	int local_width = get_local_size(0);
+	int local_height = get_local_size(1);
+	int tile_height = local_height + 2 * MASK_RADIUS;
+	int origin_y = get_group_id(1) * local_height - MASK_RADIUS; // y coordinate of the top end of the tile including the halo
+	int column = min(x, width - 1); // padding work items load a valid column
+	global const float* channel = A + c * width * height;
+
+	for (int j = ly; j < tile_height; j += local_height)
+	{
+		int global_y = get_boundary_index(origin_y + j, height);
+
+		tile[lx + j * local_width] = global_y < 0 ? 0 : channel[column + global_y * width];
+	} // end for
+
+	barrier(CLK_LOCAL_MEM_FENCE); // wait for all local threads to finish loading the tile
+
+	if (x < width && y < height)
+	{
+		float result = 0;
+
+		for (int j = 0; j < MASK_SIZE; j++)
+			result += tile[lx + (ly + j) * local_width] * mask[j];
+
+		B[x + y * width + c * width * height] = convert_uchar_sat_rte(result);
+	} // end if
+} // end function convolution_columns
+
+/*
+the following kernels read a 2D image object (e.g. CL_RGBA with CL_UNORM_INT8 or CL_UNORM_INT16) through a sampler instead of a planar buffer;
+the sampler clamps coordinates to the edge, so no branch is needed for the boundary conditions, and the texture cache of the runtime provides 2D locality;
+normalised channel values in [0, 1] are read and written, so the same kernels work for 8-bit and 16-bit images
+*/
+constant sampler_t image_sampler = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
+
+// a simple 2D identity kernel for image objects
+kernel void identity_image(read_only image2d_t A, write_only image2d_t B)
+{
+	int2 position = (int2)(get_global_id(0), get_global_id(1));
+
+	write_imagef(B, position, read_imagef(A, image_sampler, position));
+} // end function identity_image
+
+// a 2D averaging filter for image objects (the edge pixels are averaged with clamped neighbours)
+kernel void avg_filter_image(read_only image2d_t A, write_only image2d_t B)
+{
+	int x = get_global_id(0); // current x coordinate
+	int y = get_global_id(1); // current y coordinate
+	float4 result = 0;
+
+	for (int j = y - 1; j <= y + 1; j++)
+		for (int i = x - 1; i <= x + 1; i++)
+			result += read_imagef(A, image_sampler, (int2)(i, j));
+
+	write_imagef(B, (int2)(x, y), result / 9);
+} // end function avg_filter_image
+
+// a 2D convolution kernel for image objects with an odd mask size fixed at build time (MASK_SIZE)
+kernel void convolution_image(read_only image2d_t A, write_only image2d_t B, constant float* mask)
+{
+	int x = get_global_id(0); // current x coordinate
+	int y = get_global_id(1); // current y coordinate
+	float4 result = 0;
+
+	for (int j = 0; j < MASK_SIZE; j++)
+		for (int i = 0; i < MASK_SIZE; i++)
+			result += read_imagef(A, image_sampler, (int2)(x + i - MASK_RADIUS, y + j - MASK_RADIUS)) * mask[i + j * MASK_SIZE];
+
+	write_imagef(B, (int2)(x, y), result);
+} // end function convolution_image
\ No newline at end of file
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Utils.h"
+
+// operators of the generic reduction engine (a custom operator is an OpenCL C expression of "a" and "b")
+enum class ReduceOperator
+{
+	SUM,
+	MIN,
+	MAX,
+	CUSTOM
+};
+
+// OpenCL C type name and identities of the supported data types
+template <typename T> struct ReduceType;
+
+template <> struct ReduceType<int>
+{
+	static const char* Name() { return "int"; }
+	static const char* MinIdentity() { return "INT_MAX"; }
+	static const char* MaxIdentity() { return "INT_MIN"; }
+};
+
+template <> struct ReduceType<unsigned int>
+{
+	static const char* Name() { return "uint"; }
+	static const char* MinIdentity() { return "UINT_MAX"; }
+	static const char* MaxIdentity() { return "0"; }
+};
+
+template <> struct ReduceType<cl_long>
+{
+	static const char* Name() { return "long"; }
+	static const char* MinIdentity() { return "LONG_MAX"; }
+	static const char* MaxIdentity() { return "LONG_MIN"; }
+};
+
+template <> struct ReduceType<float>
+{
+	static const char* Name() { return "float"; }
+	static const char* MinIdentity() { return "INFINITY"; }
+	static const char* MaxIdentity() { return "-INFINITY"; }
+};
+
+template <> struct ReduceType<double>
+{
+	static const char* Name() { return "double"; }
+	static const char* MinIdentity() { return "INFINITY"; }
+	static const char* MaxIdentity() { return "-INFINITY"; }
+};
+
+/*
+a host wrapper of the generic reduction engine in "kernels/reduce.cl";
+the type and operator are fixed when the program is built, and inputs of any length are reduced without padding:
+stage 1 reduces the input to at most "local_size" partial results, and stage 2 reduces the partial results with a single work group
+*/
+template <typename T>
+class Reduction
+{
+public:
+	Reduction(const cl::Context& context, const cl::CommandQueue& queue, ReduceOperator op, const string& custom_op = "", const string& custom_identity = "")
+		: context_(context), queue_(queue)
+	{
+		cl::Device device = queue_.getInfo<CL_QUEUE_DEVICE>();
+		size_t max_local_size = device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>();
+
+		// use the largest power of 2 not exceeding the device limit or 256
+		local_size_ = 1;
+
+		while (local_size_ * 2 <= max_local_size && local_size_ < 256)
+			local_size_ *= 2;
+
+		stringstream defines;
+
+		if (string(ReduceType<T>::Name()) == "double")
+			defines << "#define REDUCE_FP64\n";
+
+		defines << "#define REDUCE_TYPE " << ReduceType<T>::Name() << "\n";
+		defines << "#define REDUCE_LOCAL_SIZE " << local_size_ << "\n";
+
+		switch (op)
+		{
+		case ReduceOperator::SUM:
+		default:
+			defines << "#define REDUCE_OP(a, b) ((a) + (b))\n#define REDUCE_IDENTITY 0\n";
+			break;
+
+		case ReduceOperator::MIN:
+			defines << "#define REDUCE_OP(a, b) min(a, b)\n#define REDUCE_IDENTITY " << ReduceType<T>::MinIdentity() << "\n";
+			break;
+
+		case ReduceOperator::MAX:
+			defines << "#define REDUCE_OP(a, b) max(a, b)\n#define REDUCE_IDENTITY " << ReduceType<T>::MaxIdentity() << "\n";
+			break;
+
+		case ReduceOperator::CUSTOM:
+			defines << "#define REDUCE_OP(a, b) (" << custom_op << ")\n#define REDUCE_IDENTITY (" << custom_identity << ")\n";
+			break;
+		} // end switch-case
+
+		// the generated definitions are prepended as a separate source string so that no quoting is needed in build options
+		cl::Program::Sources sources;
+
+		sources.push_back(defines.str());
+		AddSources(sources, "kernels/reduce.cl");
+
+		program_ = cl::Program(context_, sources);
+
+		try
+		{
+			program_.build({ device });
+		}
+		catch (const cl::Error& err)
+		{
+			std::cout << "Build Status: " << program_.getBuildInfo<CL_PROGRAM_BUILD_STATUS>(device) << std::endl;
+			std::cout << "Build Options:\t" << program_.getBuildInfo<CL_PROGRAM_BUILD_OPTIONS>(device) << std::endl;
+			std::cout << "Build Log:\t " << program_.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device) << std::endl;
+			throw err;
+		} // end try...catch
+
+		kernel_ = cl::Kernel(program_, "reduce");
+		buffer_partial_ = cl::Buffer(context_, CL_MEM_READ_WRITE, local_size_ * sizeof(T));
+		buffer_result_ = cl::Buffer(context_, CL_MEM_READ_WRITE, sizeof(T));
+	} // end constructor
+
+	// reduce the first "elements" elements of a device buffer
+	T Run(const cl::Buffer& buffer_A, size_t elements)
+	{
+		size_t group_count = (elements + 2 * local_size_ - 1) / (2 * local_size_); // each work item handles at least 2 elements
+
+		if (group_count > local_size_)
+			group_count = local_size_; // stage 2 must fit in a single work group
+		else if (group_count == 0)
+			group_count = 1;
+
+		T result;
+
+		// stage 1: reduce the input to "group_count" partial results
+		kernel_.setArg(0, buffer_A);
+		kernel_.setArg(1, buffer_partial_);
+		kernel_.setArg(2, (cl_ulong)elements);
+		queue_.enqueueNDRangeKernel(kernel_, cl::NullRange, cl::NDRange(group_count * local_size_), cl::NDRange(local_size_));
+
+		// stage 2: reduce the partial results with a single work group
+		kernel_.setArg(0, buffer_partial_);
+		kernel_.setArg(1, buffer_result_);
+		kernel_.setArg(2, (cl_ulong)group_count);
+		queue_.enqueueNDRangeKernel(kernel_, cl::NullRange, cl::NDRange(local_size_), cl::NDRange(local_size_));
+
+		queue_.enqueueReadBuffer(buffer_result_, CL_TRUE, 0, sizeof(T), &result);
+
+		return result;
+	} // end function Run
+
+	// reduce a host vector of any length
+	T Run(const vector<T>& A)
+	{
+		if (A.empty())
+			throw cl::Error(CL_INVALID_VALUE, "Reduction::Run");
+
+		cl::Buffer buffer_A(context_, CL_MEM_READ_ONLY, A.size() * sizeof(T));
+
+		queue_.enqueueWriteBuffer(buffer_A, CL_FALSE, 0, A.size() * sizeof(T), &A[0]);
+
+		return Run(buffer_A, A.size());
+	} // end function Run
+
+private:
+	cl::Context context_;
+	cl::CommandQueue queue_;
+	cl::Program program_;
+	cl::Kernel kernel_;
+	cl::Buffer buffer_partial_; // partial results of stage 1
+	cl::Buffer buffer_result_; // final result of stage 2
+	size_t local_size_;
+}; // end class Reduction
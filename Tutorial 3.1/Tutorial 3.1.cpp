@@ -1,7 +1,10 @@
+#include <algorithm>
 #include <iostream>
+#include <numeric>
 #include <vector>
 
 #include "Utils.h"
+#include "Reduce.h"
 
 void print_help()
 {
@@ -9,6 +12,7 @@ void print_help()
 	std::cerr << "  -p : select platform " << std::endl;
 	std::cerr << "  -d : select device" << std::endl;
 	std::cerr << "  -l : list all platforms and devices, and run on the first device of the first platform" << std::endl;
+	std::cerr << "  -r : run the generic reduction engine on a vector of the specified length (e.g. -r 1000003) instead of the tutorial kernel" << std::endl;
 	std::cerr << "  -h : print this message" << std::endl;
 } // end function print_help
 
@@ -17,6 +21,7 @@ int main(int argc, char **argv)
 	// Part 1 - handle command line options such as device selection, verbosity, etc.
 	int platform_id = 0;
 	int device_id = 0;
+	size_t reduce_elements = 0; // 0 means running the tutorial kernel
 
 	for (int i = 1; i < argc; i++)
 	{
@@ -26,6 +31,8 @@ int main(int argc, char **argv)
 			device_id = atoi(argv[++i]);
 		else if (strcmp(argv[i], "-l") == 0)
 			std::cout << ListPlatformsDevices() << std::endl;
+		else if ((strcmp(argv[i], "-r") == 0) && (i < (argc - 1)))
+			reduce_elements = (size_t)atoll(argv[++i]);
 		else if (strcmp(argv[i], "-h") == 0)
 		{
 			print_help();
@@ -64,6 +71,36 @@ int main(int argc, char **argv)
 			throw err;
 		} // end try...catch
 
+		/*
+		reduce a vector of arbitrary length with the generic reduction engine (no padding needed);
+		the results are compared with the ones computed on the host
+		*/
+		if (reduce_elements)
+		{
+			std::vector<int> R(reduce_elements);
+			std::vector<float> R_float(reduce_elements);
+
+			for (size_t i = 0; i < reduce_elements; i++)
+			{
+				R[i] = (int)(i % 100) - 50;
+				R_float[i] = R[i] * 0.5f;
+			} // end for
+
+			int sum = Reduction<int>(context, queue, ReduceOperator::SUM).Run(R);
+			int minimum = Reduction<int>(context, queue, ReduceOperator::MIN).Run(R);
+			int maximum = Reduction<int>(context, queue, ReduceOperator::MAX).Run(R);
+			float max_float = Reduction<float>(context, queue, ReduceOperator::MAX).Run(R_float);
+			int max_abs = Reduction<int>(context, queue, ReduceOperator::CUSTOM, "max(abs(a), abs(b))", "0").Run(R); // a custom operator
+
+			std::cout << "sum = " << sum << " (host: " << std::accumulate(R.begin(), R.end(), 0) << ")" << std::endl;
+			std::cout << "min = " << minimum << " (host: " << *std::min_element(R.begin(), R.end()) << ")" << std::endl;
+			std::cout << "max = " << maximum << " (host: " << *std::max_element(R.begin(), R.end()) << ")" << std::endl;
+			std::cout << "max (float) = " << max_float << " (host: " << *std::max_element(R_float.begin(), R_float.end()) << ")" << std::endl;
+			std::cout << "max |x| = " << max_abs << " (host: " << std::accumulate(R.begin(), R.end(), 0, [](int a, int b) { return std::max(a, std::abs(b)); }) << ")" << std::endl;
+
+			return 0;
+		} // end if
+
 		typedef int mytype;
 
 		// Part 3 - memory allocation
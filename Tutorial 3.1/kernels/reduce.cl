@@ -0,0 +1,69 @@
+/*
+a generic reduction engine evolved from "reduce_add_1" to "reduce_add_5";
+the data type, operator, identity, and work group size are fixed at build time by definitions in a source string prepended to this file, e.g.
+"#define REDUCE_TYPE float", "#define REDUCE_OP(a, b) max(a, b)", "#define REDUCE_IDENTITY -INFINITY", and "#define REDUCE_LOCAL_SIZE 256";
+"Reduce.h" generates these definitions for sum, min, max, and custom operators (the defaults below apply if none are given)
+*/
+#ifdef REDUCE_FP64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+#endif
+
+#ifndef REDUCE_TYPE
+#define REDUCE_TYPE int
+#endif
+
+#ifndef REDUCE_OP
+#define REDUCE_OP(a, b) ((a) + (b))
+#endif
+
+#ifndef REDUCE_IDENTITY
+#define REDUCE_IDENTITY 0
+#endif
+
+// the work group size must be a power of 2
+#ifndef REDUCE_LOCAL_SIZE
+#define REDUCE_LOCAL_SIZE 256
+#endif
+
+/*
+reduce the elements handled by a work group to a single value using sequential addressing;
+each work item first accumulates many elements in a grid-stride loop (no padding of the input is needed as out-of-range work items keep the identity),
+then the work group reduces its private values in local memory with a loop of fixed trip count that the compiler can fully unroll;
+the result of each work group is written to "B[group_id]" so no atomic operation is used;
+launching it again with a single work group on the partial results completes the reduction (2-stage reduction),
+and the result is deterministic for a given launch configuration as the order of the operations is fixed
+*/
+kernel __attribute__((reqd_work_group_size(REDUCE_LOCAL_SIZE, 1, 1)))
+void reduce(global const REDUCE_TYPE* A, global REDUCE_TYPE* B, const ulong N)
+{
+	local REDUCE_TYPE scratch[REDUCE_LOCAL_SIZE];
+	size_t id = get_global_id(0);
+	int lid = get_local_id(0);
+	size_t stride = get_global_size(0);
+	REDUCE_TYPE accumulator = REDUCE_IDENTITY;
+
+	// accumulate 2 elements per iteration to halve the loop overhead
+	for (; id + stride < N; id += 2 * stride)
+		accumulator = REDUCE_OP(accumulator, REDUCE_OP(A[id], A[id + stride]));
+
+	if (id < N)
+		accumulator = REDUCE_OP(accumulator, A[id]);
+
+	scratch[lid] = accumulator;
+
+	barrier(CLK_LOCAL_MEM_FENCE); // wait for all local threads to finish writing their private values
+
+	// "i" represents the stride; the trip count only depends on "REDUCE_LOCAL_SIZE", so the loop (including its tail) is unrolled
+#pragma unroll
+	for (int i = REDUCE_LOCAL_SIZE / 2; i > 0; i >>= 1)
+	{
+		if (lid < i)
+			scratch[lid] = REDUCE_OP(scratch[lid], scratch[lid + i]);
+
+		barrier(CLK_LOCAL_MEM_FENCE);
+	} // end for
+
+	// copy the result of the work group to the output array
+	if (!lid)
+		B[get_group_id(0)] = scratch[0];
+} // end function reduce
\ No newline at end of file
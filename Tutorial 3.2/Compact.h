@@ -0,0 +1,122 @@
+#pragma once
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Scan.h"
+#include "Utils.h"
+
+// OpenCL C type names of the supported data types
+template <typename T> struct CompactType;
+
+template <> struct CompactType<int> { static const char* Name() { return "int"; } };
+template <> struct CompactType<unsigned int> { static const char* Name() { return "uint"; } };
+template <> struct CompactType<cl_ushort> { static const char* Name() { return "ushort"; } };
+template <> struct CompactType<float> { static const char* Name() { return "float"; } };
+
+/*
+a host wrapper of the stream compaction in "kernels/compact.cl", e.g. extracting the pixels above a threshold or the non-empty bins of a histogram;
+the predicate is an OpenCL C expression of "x" fixed when the program is built;
+"Run" only enqueues commands, and the number of selected elements is left in a device buffer ("GetCount"), so the following kernels can take it as an argument
+and bound their work with it instead of waiting for a blocking read ("ReadCount" is a blocking convenience)
+*/
+template <typename T>
+class Compaction
+{
+public:
+	Compaction(const cl::Context& context, const cl::CommandQueue& queue, const string& predicate)
+		: context_(context), queue_(queue), buffer_count_(context, CL_MEM_READ_WRITE, sizeof(cl_uint)), capacity_(0)
+	{
+		cl::Device device = queue_.getInfo<CL_QUEUE_DEVICE>();
+		stringstream defines;
+
+		defines << "#define COMPACT_TYPE " << CompactType<T>::Name() << "\n";
+		defines << "#define COMPACT_PREDICATE(x) (" << predicate << ")\n";
+
+		// the generated definitions are prepended as a separate source string so that no quoting is needed in build options
+		cl::Program::Sources sources;
+
+		sources.push_back(defines.str());
+		AddSources(sources, "kernels/my_kernels.cl");
+		AddSources(sources, "kernels/compact.cl");
+
+		program_ = cl::Program(context_, sources);
+
+		try
+		{
+			program_.build({ device });
+		}
+		catch (const cl::Error& err)
+		{
+			std::cout << "Build Status: " << program_.getBuildInfo<CL_PROGRAM_BUILD_STATUS>(device) << std::endl;
+			std::cout << "Build Options:\t" << program_.getBuildInfo<CL_PROGRAM_BUILD_OPTIONS>(device) << std::endl;
+			std::cout << "Build Log:\t " << program_.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device) << std::endl;
+			throw err;
+		} // end try...catch
+
+		kernel_flags_ = cl::Kernel(program_, "compact_flags");
+		kernel_scatter_ = cl::Kernel(program_, "compact_scatter");
+		scan_.reset(new ExclusiveScan(context_, queue_, program_));
+	} // end constructor
+
+	/*
+	enqueue the compaction of the first "elements" elements of "buffer_A";
+	the selected elements are written to the front of "buffer_B" and their indices in "buffer_A" to the front of "buffer_indices" (both should hold "elements" elements)
+	*/
+	void Run(const cl::Buffer& buffer_A, size_t elements, const cl::Buffer& buffer_B, const cl::Buffer& buffer_indices)
+	{
+		if (!elements)
+		{
+			queue_.enqueueFillBuffer(buffer_count_, (cl_uint)0, 0, sizeof(cl_uint));
+
+			return;
+		} // end if
+
+		if (elements > capacity_)
+		{
+			buffer_positions_ = cl::Buffer(context_, CL_MEM_READ_WRITE, elements * sizeof(cl_uint));
+			capacity_ = elements;
+		} // end if
+
+		kernel_flags_.setArg(0, buffer_A);
+		kernel_flags_.setArg(1, buffer_positions_);
+		kernel_flags_.setArg(2, (cl_uint)elements);
+		queue_.enqueueNDRangeKernel(kernel_flags_, cl::NullRange, cl::NDRange(elements), cl::NullRange);
+
+		scan_->Run(buffer_positions_, elements);
+
+		kernel_scatter_.setArg(0, buffer_A);
+		kernel_scatter_.setArg(1, buffer_positions_);
+		kernel_scatter_.setArg(2, buffer_B);
+		kernel_scatter_.setArg(3, buffer_indices);
+		kernel_scatter_.setArg(4, buffer_count_);
+		kernel_scatter_.setArg(5, (cl_uint)elements);
+		queue_.enqueueNDRangeKernel(kernel_scatter_, cl::NullRange, cl::NDRange(elements), cl::NullRange);
+	} // end function Run
+
+	// the device buffer holding the number of elements selected by the last run
+	const cl::Buffer& GetCount() const { return buffer_count_; }
+
+	// wait for the last run and read the number of selected elements
+	size_t ReadCount()
+	{
+		cl_uint count;
+
+		queue_.enqueueReadBuffer(buffer_count_, CL_TRUE, 0, sizeof(cl_uint), &count);
+
+		return count;
+	} // end function ReadCount
+
+private:
+	cl::Context context_;
+	cl::CommandQueue queue_;
+	cl::Program program_;
+	cl::Kernel kernel_flags_;
+	cl::Kernel kernel_scatter_;
+	std::unique_ptr<ExclusiveScan> scan_; // created once the program is built
+	cl::Buffer buffer_count_;
+	cl::Buffer buffer_positions_; // the flags, scanned in place into output positions
+	size_t capacity_;
+}; // end class Compaction
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "Scan.h"
+#include "Utils.h"
+
+/*
+a host wrapper of the LSD radix sort kernels in "kernels/my_kernels.cl" for 32-bit unsigned keys, optionally carrying 32-bit values;
+each of the 8 passes sorts by 4 bits: "radix_histogram" counts the digits of each block, "scan_exclusive" turns the counts into output offsets,
+and "radix_scatter" writes the keys of each block to their offsets in a stable way, so keys with the same digit keep the order of the previous pass;
+passes ping-pong between the input and a temporary buffer, and the number of passes is even, so the sorted keys end in the input buffer
+*/
+class RadixSort
+{
+public:
+	RadixSort(const cl::Context& context, const cl::CommandQueue& queue, const cl::Program& program)
+		: context_(context), queue_(queue), scan_(context, queue, program), kernel_histogram_(program, "radix_histogram"), kernel_scatter_(program, "radix_scatter")
+	{
+		cl::Device device = queue_.getInfo<CL_QUEUE_DEVICE>();
+
+		// use up to 256 work items per group as long as every kernel can run with it
+		local_size_ = 256;
+		local_size_ = std::min(local_size_, kernel_histogram_.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+		local_size_ = std::min(local_size_, kernel_scatter_.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+	} // end constructor
+
+	// sort the first "elements" keys of a device buffer
+	void Sort(const cl::Buffer& buffer_keys, size_t elements)
+	{
+		Sort(buffer_keys, cl::Buffer(), elements);
+	} // end function Sort
+
+	// sort the first "elements" keys of a device buffer and move the values of another device buffer with them ("buffer_values" may be a null buffer)
+	void Sort(const cl::Buffer& buffer_keys, const cl::Buffer& buffer_values, size_t elements)
+	{
+		if (!elements)
+			return;
+
+		bool has_values = buffer_values() != NULL;
+		size_t group_count = (elements + local_size_ - 1) / local_size_;
+		size_t offset_count = RADIX * group_count;
+		cl::Buffer buffer_keys_temp(context_, CL_MEM_READ_WRITE, elements * sizeof(cl_uint));
+		cl::Buffer buffer_values_temp(context_, CL_MEM_READ_WRITE, (has_values ? elements : 1) * sizeof(cl_uint));
+		cl::Buffer buffer_offsets(context_, CL_MEM_READ_WRITE, offset_count * sizeof(cl_uint));
+
+		cl::Buffer from_keys = buffer_keys, to_keys = buffer_keys_temp;
+		cl::Buffer from_values = has_values ? buffer_values : buffer_values_temp, to_values = buffer_values_temp;
+
+		for (int shift = 0; shift < 32; shift += RADIX_BITS)
+		{
+			kernel_histogram_.setArg(0, from_keys);
+			kernel_histogram_.setArg(1, buffer_offsets);
+			kernel_histogram_.setArg(2, cl::Local(RADIX * sizeof(cl_uint))); // local memory size
+			kernel_histogram_.setArg(3, shift);
+			kernel_histogram_.setArg(4, (cl_uint)elements);
+			queue_.enqueueNDRangeKernel(kernel_histogram_, cl::NullRange, cl::NDRange(group_count * local_size_), cl::NDRange(local_size_));
+
+			scan_.Run(buffer_offsets, offset_count);
+
+			kernel_scatter_.setArg(0, from_keys);
+			kernel_scatter_.setArg(1, from_values);
+			kernel_scatter_.setArg(2, to_keys);
+			kernel_scatter_.setArg(3, to_values);
+			kernel_scatter_.setArg(4, buffer_offsets);
+			kernel_scatter_.setArg(5, cl::Local(local_size_ * sizeof(cl_uint)));
+			kernel_scatter_.setArg(6, cl::Local(local_size_ * sizeof(cl_uint)));
+			kernel_scatter_.setArg(7, cl::Local(local_size_ * sizeof(cl_uint)));
+			kernel_scatter_.setArg(8, cl::Local(local_size_ * sizeof(cl_uint)));
+			kernel_scatter_.setArg(9, shift);
+			kernel_scatter_.setArg(10, (cl_uint)elements);
+			kernel_scatter_.setArg(11, (int)has_values);
+			queue_.enqueueNDRangeKernel(kernel_scatter_, cl::NullRange, cl::NDRange(group_count * local_size_), cl::NDRange(local_size_));
+
+			std::swap(from_keys, to_keys);
+
+			if (has_values)
+				std::swap(from_values, to_values);
+		} // end for
+	} // end function Sort
+
+	// sort a host vector of keys
+	void Sort(std::vector<cl_uint>& keys)
+	{
+		if (keys.empty())
+			return;
+
+		cl::Buffer buffer_keys(context_, CL_MEM_READ_WRITE, keys.size() * sizeof(cl_uint));
+
+		queue_.enqueueWriteBuffer(buffer_keys, CL_FALSE, 0, keys.size() * sizeof(cl_uint), &keys[0]);
+		Sort(buffer_keys, keys.size());
+		queue_.enqueueReadBuffer(buffer_keys, CL_TRUE, 0, keys.size() * sizeof(cl_uint), &keys[0]);
+	} // end function Sort
+
+	// sort a host vector of keys and move the values with them; values of equal keys keep their order
+	void Sort(std::vector<cl_uint>& keys, std::vector<cl_uint>& values)
+	{
+		if (keys.size() != values.size())
+			throw cl::Error(CL_INVALID_VALUE, "RadixSort::Sort");
+
+		if (keys.empty())
+			return;
+
+		size_t size = keys.size() * sizeof(cl_uint);
+		cl::Buffer buffer_keys(context_, CL_MEM_READ_WRITE, size);
+		cl::Buffer buffer_values(context_, CL_MEM_READ_WRITE, size);
+
+		queue_.enqueueWriteBuffer(buffer_keys, CL_FALSE, 0, size, &keys[0]);
+		queue_.enqueueWriteBuffer(buffer_values, CL_FALSE, 0, size, &values[0]);
+		Sort(buffer_keys, buffer_values, keys.size());
+		queue_.enqueueReadBuffer(buffer_keys, CL_FALSE, 0, size, &keys[0]);
+		queue_.enqueueReadBuffer(buffer_values, CL_TRUE, 0, size, &values[0]);
+	} // end function Sort
+
+private:
+	static const int RADIX_BITS = 4; // must match "RADIX_BITS" in the kernels
+	static const int RADIX = 1 << RADIX_BITS;
+
+	cl::Context context_;
+	cl::CommandQueue queue_;
+	ExclusiveScan scan_; // the scan of the digit offsets
+	cl::Kernel kernel_histogram_;
+	cl::Kernel kernel_scatter_;
+	size_t local_size_;
+}; // end class RadixSort
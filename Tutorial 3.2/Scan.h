@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "Utils.h"
+
+/*
+a host wrapper of an in-place exclusive scan of 32-bit unsigned values of any length with kernels "scan_exclusive" and "scan_exclusive_adjust" in "kernels/my_kernels.cl":
+each block is scanned by a work group, the block sums are scanned recursively, and the scanned block sums are added back to the blocks;
+the buffers of block sums are kept between runs and only reallocated for a longer input
+*/
+class ExclusiveScan
+{
+public:
+	ExclusiveScan(const cl::Context& context, const cl::CommandQueue& queue, const cl::Program& program)
+		: context_(context), queue_(queue), kernel_scan_(program, "scan_exclusive"), kernel_adjust_(program, "scan_exclusive_adjust"), capacity_(0)
+	{
+		cl::Device device = queue_.getInfo<CL_QUEUE_DEVICE>();
+
+		local_size_ = std::min((size_t)256, kernel_scan_.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+	} // end constructor
+
+	// scan the first "elements" values of a device buffer in place
+	void Run(const cl::Buffer& buffer_A, size_t elements)
+	{
+		if (!elements)
+			return;
+
+		if (elements > capacity_)
+		{
+			block_sums_.clear();
+
+			// one level is needed per factor of "local_size_"
+			for (size_t n = elements; ; n = (n + local_size_ - 1) / local_size_)
+			{
+				block_sums_.push_back(cl::Buffer(context_, CL_MEM_READ_WRITE, (n + local_size_ - 1) / local_size_ * sizeof(cl_uint)));
+
+				if (n <= local_size_)
+					break;
+			} // end for
+
+			capacity_ = elements;
+		} // end if
+
+		Scan(buffer_A, elements, 0);
+	} // end function Run
+
+private:
+	void Scan(const cl::Buffer& buffer_A, size_t elements, size_t level)
+	{
+		size_t group_count = (elements + local_size_ - 1) / local_size_;
+
+		kernel_scan_.setArg(0, buffer_A);
+		kernel_scan_.setArg(1, block_sums_[level]);
+		kernel_scan_.setArg(2, cl::Local(local_size_ * sizeof(cl_uint))); // local memory size
+		kernel_scan_.setArg(3, cl::Local(local_size_ * sizeof(cl_uint)));
+		kernel_scan_.setArg(4, (cl_uint)elements);
+		queue_.enqueueNDRangeKernel(kernel_scan_, cl::NullRange, cl::NDRange(group_count * local_size_), cl::NDRange(local_size_));
+
+		if (group_count > 1)
+		{
+			Scan(block_sums_[level], group_count, level + 1);
+
+			kernel_adjust_.setArg(0, buffer_A);
+			kernel_adjust_.setArg(1, block_sums_[level]);
+			kernel_adjust_.setArg(2, (cl_uint)elements);
+			queue_.enqueueNDRangeKernel(kernel_adjust_, cl::NullRange, cl::NDRange(group_count * local_size_), cl::NDRange(local_size_));
+		} // end if
+	} // end function Scan
+
+	cl::Context context_;
+	cl::CommandQueue queue_;
+	cl::Kernel kernel_scan_;
+	cl::Kernel kernel_adjust_;
+	std::vector<cl::Buffer> block_sums_; // the block sums of each level
+	size_t capacity_; // the longest input the block sums can hold
+	size_t local_size_;
+}; // end class ExclusiveScan
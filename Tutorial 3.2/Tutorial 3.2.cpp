@@ -1,6 +1,10 @@
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <vector>
 
+#include "Compact.h"
+#include "RadixSort.h"
 #include "Utils.h"
 
 void print_help()
@@ -9,14 +13,218 @@ void print_help()
 	std::cerr << "  -p : select platform " << std::endl;
 	std::cerr << "  -d : select device" << std::endl;
 	std::cerr << "  -l : list all platforms and devices, and run on the first device of the first platform" << std::endl;
+	std::cerr << "  -s : run a box filter with a summed-area table on a synthetic 16-bit image of the specified size (size x size) instead of the scan" << std::endl;
+	std::cerr << "  -r : specify the radius of the box filter (1 by default)" << std::endl;
+	std::cerr << "  -x : sort the specified number of random 32-bit keys (with their indices as values) with the radix sort and compare it with std::sort instead of the scan" << std::endl;
+	std::cerr << "  -t : extract the values above the specified threshold from a synthetic 16-bit signal of 1M samples with the stream compaction instead of the scan" << std::endl;
 	std::cerr << "  -h : print this message" << std::endl;
 } // end function print_help
 
+// get the execution time of a finished command in nanoseconds
+cl_ulong get_event_time(const cl::Event& event)
+{
+	return event.getProfilingInfo<CL_PROFILING_COMMAND_END>() - event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+} // end function get_event_time
+
+/*
+build a summed-area table of a synthetic 16-bit image on the device and run a box filter of a radius with it;
+Step 1 scans the rows, Step 2 transposes the row sums, Step 3 scans the columns (the rows of the transposed sums), and Step 4 runs the box filter on the transposed table;
+the result is checked against a box filter computed on the host
+*/
+void run_box_filter(const cl::Context& context, const cl::CommandQueue& queue, const cl::Program& program, int width, int height, int radius)
+{
+	size_t image_elements = (size_t)width * height;
+	std::vector<cl_ushort> image(image_elements);
+	std::vector<cl_ushort> output(image_elements);
+	cl::Device device = context.getInfo<CL_CONTEXT_DEVICES>()[0];
+
+	for (size_t i = 0; i < image_elements; i++)
+		image[i] = (cl_ushort)((i * 2654435761u) >> 16); // deterministic values covering the whole 16-bit range
+
+	cl::Buffer buffer_image(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, image_elements * sizeof(cl_ushort), &image[0]);
+	cl::Buffer buffer_row_sums(context, CL_MEM_READ_WRITE, image_elements * sizeof(cl_ulong));
+	cl::Buffer buffer_transposed(context, CL_MEM_READ_WRITE, image_elements * sizeof(cl_ulong));
+	cl::Buffer buffer_SAT_T(context, CL_MEM_READ_WRITE, image_elements * sizeof(cl_ulong));
+	cl::Buffer buffer_output(context, CL_MEM_WRITE_ONLY, image_elements * sizeof(cl_ushort));
+
+	cl::Kernel kernel_1 = cl::Kernel(program, "scan_rows_16"); // scan the rows (Step 1)
+	cl::Kernel kernel_2 = cl::Kernel(program, "transpose"); // transpose the row sums through local memory (Step 2)
+	cl::Kernel kernel_3 = cl::Kernel(program, "scan_rows_64"); // scan the columns (Step 3)
+	cl::Kernel kernel_4 = cl::Kernel(program, "box_filter"); // a box filter with 4 lookups per pixel (Step 4)
+
+	// a scan uses up to 256 work items per row, and a transpose uses square tiles of up to 16x16 work items
+	size_t scan_size = std::min((size_t)256, kernel_1.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+	size_t tile_size = 16;
+
+	while (tile_size * tile_size > kernel_2.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device))
+		tile_size /= 2;
+
+	kernel_1.setArg(0, buffer_image);
+	kernel_1.setArg(1, buffer_row_sums);
+	kernel_1.setArg(2, cl::Local(scan_size * sizeof(cl_ulong))); // local memory size
+	kernel_1.setArg(3, cl::Local(scan_size * sizeof(cl_ulong)));
+	kernel_1.setArg(4, width);
+
+	kernel_2.setArg(0, buffer_row_sums);
+	kernel_2.setArg(1, buffer_transposed);
+	kernel_2.setArg(2, cl::Local(tile_size * (tile_size + 1) * sizeof(cl_ulong))); // local memory size of a padded tile
+	kernel_2.setArg(3, width);
+	kernel_2.setArg(4, height);
+
+	kernel_3.setArg(0, buffer_transposed);
+	kernel_3.setArg(1, buffer_SAT_T);
+	kernel_3.setArg(2, cl::Local(scan_size * sizeof(cl_ulong)));
+	kernel_3.setArg(3, cl::Local(scan_size * sizeof(cl_ulong)));
+	kernel_3.setArg(4, height); // the rows of the transposed sums are as long as the columns of the image
+
+	kernel_4.setArg(0, buffer_SAT_T);
+	kernel_4.setArg(1, buffer_output);
+	kernel_4.setArg(2, width);
+	kernel_4.setArg(3, height);
+	kernel_4.setArg(4, radius);
+
+	cl::Event event_1, event_2, event_3, event_4;
+
+	queue.enqueueNDRangeKernel(kernel_1, cl::NullRange, cl::NDRange(scan_size, height), cl::NDRange(scan_size, 1), NULL, &event_1);
+	queue.enqueueNDRangeKernel(kernel_2, cl::NullRange, cl::NDRange((width + tile_size - 1) / tile_size * tile_size, (height + tile_size - 1) / tile_size * tile_size),
+		cl::NDRange(tile_size, tile_size), NULL, &event_2);
+	queue.enqueueNDRangeKernel(kernel_3, cl::NullRange, cl::NDRange(scan_size, width), cl::NDRange(scan_size, 1), NULL, &event_3);
+	queue.enqueueNDRangeKernel(kernel_4, cl::NullRange, cl::NDRange(width, height), cl::NullRange, NULL, &event_4);
+	queue.enqueueReadBuffer(buffer_output, CL_TRUE, 0, image_elements * sizeof(cl_ushort), &output[0]);
+
+	// the host reference uses the same clipped windows
+	std::vector<cl_ulong> SAT((size_t)(width + 1) * (height + 1), 0);
+	size_t mismatches = 0;
+
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++)
+			SAT[(y + 1) * (width + 1) + x + 1] = image[y * width + x] + SAT[y * (width + 1) + x + 1] + SAT[(y + 1) * (width + 1) + x] - SAT[y * (width + 1) + x];
+
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++)
+		{
+			int x0 = std::max(x - radius, 0), y0 = std::max(y - radius, 0);
+			int x1 = std::min(x + radius, width - 1) + 1, y1 = std::min(y + radius, height - 1) + 1;
+			cl_ulong sum = SAT[y1 * (width + 1) + x1] - SAT[y0 * (width + 1) + x1] - SAT[y1 * (width + 1) + x0] + SAT[y0 * (width + 1) + x0];
+
+			if (output[y * width + x] != sum / ((cl_ulong)(x1 - x0) * (y1 - y0)))
+				mismatches++;
+		} // end for
+
+	std::cout << width << "x" << height << " image, radius " << radius << ", " << mismatches << " mismatches against the host" << std::endl;
+	std::cout << "Kernel execution time (unit: ns): row scan " << get_event_time(event_1) << ", transpose " << get_event_time(event_2)
+		<< ", column scan " << get_event_time(event_3) << ", box filter " << get_event_time(event_4) << std::endl;
+} // end function run_box_filter
+
+/*
+sort random 32-bit keys on the device with the radix sort and on the host with "std::sort", and compare the results and times;
+the indices of the keys are sorted with them as values, and the sort is checked to be stable, i.e. the values of equal keys stay in ascending order
+*/
+void run_radix_sort(const cl::Context& context, const cl::CommandQueue& queue, const cl::Program& program, size_t elements)
+{
+	std::vector<cl_uint> keys(elements), values(elements);
+
+	for (size_t i = 0; i < elements; i++)
+	{
+		keys[i] = (cl_uint)((i * 2654435761u) ^ (i >> 3)) % 1000003; // deterministic keys with many duplicates
+		values[i] = (cl_uint)i;
+	} // end for
+
+	std::vector<cl_uint> expected = keys;
+	RadixSort radix_sort(context, queue, program);
+	cl::Buffer buffer_keys(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, elements * sizeof(cl_uint), &keys[0]);
+	cl::Buffer buffer_values(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, elements * sizeof(cl_uint), &values[0]);
+
+	queue.finish(); // exclude the upload from the timing
+
+	auto device_start = std::chrono::high_resolution_clock::now();
+
+	radix_sort.Sort(buffer_keys, buffer_values, elements);
+	queue.finish();
+
+	auto device_end = std::chrono::high_resolution_clock::now();
+
+	queue.enqueueReadBuffer(buffer_keys, CL_FALSE, 0, elements * sizeof(cl_uint), &keys[0]);
+	queue.enqueueReadBuffer(buffer_values, CL_TRUE, 0, elements * sizeof(cl_uint), &values[0]);
+
+	auto host_start = std::chrono::high_resolution_clock::now();
+
+	std::sort(expected.begin(), expected.end());
+
+	auto host_end = std::chrono::high_resolution_clock::now();
+	size_t mismatches = 0, unstable = 0;
+
+	for (size_t i = 0; i < elements; i++)
+	{
+		if (keys[i] != expected[i])
+			mismatches++;
+
+		if (i > 0 && keys[i] == keys[i - 1] && values[i] < values[i - 1])
+			unstable++;
+	} // end for
+
+	std::cout << elements << " keys, " << mismatches << " mismatches against std::sort, " << unstable << " unstable pairs" << std::endl;
+	std::cout << "Sort time (unit: ns): radix sort " << std::chrono::duration_cast<std::chrono::nanoseconds>(device_end - device_start).count()
+		<< ", std::sort " << std::chrono::duration_cast<std::chrono::nanoseconds>(host_end - host_start).count() << std::endl;
+} // end function run_radix_sort
+
+/*
+extract the samples of a synthetic 16-bit signal above a threshold and their indices with the stream compaction, and check them against a filter on the host;
+the count is only read back at the end, as the compaction itself never waits for the device
+*/
+void run_compaction(const cl::Context& context, const cl::CommandQueue& queue, size_t elements, int threshold)
+{
+	std::vector<cl_ushort> A(elements);
+
+	for (size_t i = 0; i < elements; i++)
+		A[i] = (cl_ushort)((i * 2654435761u) >> 16); // deterministic values covering the whole 16-bit range
+
+	Compaction<cl_ushort> compaction(context, queue, "x > " + std::to_string(threshold));
+	cl::Buffer buffer_A(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, elements * sizeof(cl_ushort), &A[0]);
+	cl::Buffer buffer_B(context, CL_MEM_WRITE_ONLY, elements * sizeof(cl_ushort));
+	cl::Buffer buffer_indices(context, CL_MEM_WRITE_ONLY, elements * sizeof(cl_uint));
+
+	queue.finish(); // exclude the upload from the timing
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	compaction.Run(buffer_A, elements, buffer_B, buffer_indices);
+
+	size_t count = compaction.ReadCount();
+	auto end = std::chrono::high_resolution_clock::now();
+	std::vector<cl_ushort> B(count);
+	std::vector<cl_uint> indices(count);
+
+	if (count)
+	{
+		queue.enqueueReadBuffer(buffer_B, CL_FALSE, 0, count * sizeof(cl_ushort), &B[0]);
+		queue.enqueueReadBuffer(buffer_indices, CL_TRUE, 0, count * sizeof(cl_uint), &indices[0]);
+	} // end if
+
+	size_t expected_count = 0, mismatches = 0;
+
+	for (size_t i = 0; i < elements; i++)
+		if (A[i] > threshold)
+		{
+			if (expected_count >= count || B[expected_count] != A[i] || indices[expected_count] != i)
+				mismatches++;
+
+			expected_count++;
+		} // end if
+
+	std::cout << count << " of " << elements << " samples above " << threshold << " (" << expected_count << " expected), " << mismatches << " mismatches against the host" << std::endl;
+	std::cout << "Compaction time (unit: ns): " << std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() << std::endl;
+} // end function run_compaction
+
 int main(int argc, char **argv)
 {
 	// Part 1 - handle command line options such as device selection, verbosity, etc.
 	int platform_id = 0;
 	int device_id = 0;
+	int image_size = 0; // 0 means running the scan
+	int radius = 1;
+	size_t sort_size = 0; // 0 means running the scan
+	int threshold = -1; // a negative value means running the scan
 
 	for (int i = 1; i < argc; i++)
 	{
@@ -26,6 +234,14 @@ int main(int argc, char **argv)
 			device_id = atoi(argv[++i]);
 		else if (strcmp(argv[i], "-l") == 0)
 			std::cout << ListPlatformsDevices() << std::endl;
+		else if ((strcmp(argv[i], "-s") == 0) && (i < (argc - 1)))
+			image_size = atoi(argv[++i]);
+		else if ((strcmp(argv[i], "-r") == 0) && (i < (argc - 1)))
+			radius = atoi(argv[++i]);
+		else if ((strcmp(argv[i], "-x") == 0) && (i < (argc - 1)))
+			sort_size = strtoul(argv[++i], NULL, 10);
+		else if ((strcmp(argv[i], "-t") == 0) && (i < (argc - 1)))
+			threshold = atoi(argv[++i]);
 		else if (strcmp(argv[i], "-h") == 0)
 		{
 			print_help();
@@ -42,7 +258,7 @@ int main(int argc, char **argv)
 
 		std::cout << "Running on " << GetPlatformName(platform_id) << ", " << GetDeviceName(platform_id, device_id) << std::endl; // display the selected device
 
-		cl::CommandQueue queue(context); // create a queue to which we will push commands for the device
+		cl::CommandQueue queue(context, CL_QUEUE_PROFILING_ENABLE); // create a queue to which we will push commands for the device and enable profiling for the queue
 
 		// 2.2 Load & build the device code
 		cl::Program::Sources sources;
@@ -64,6 +280,27 @@ int main(int argc, char **argv)
 			throw err;
 		} // end try...catch
 
+		if (image_size > 0)
+		{
+			run_box_filter(context, queue, program, image_size, image_size, radius);
+
+			return 0;
+		} // end if
+
+		if (threshold >= 0)
+		{
+			run_compaction(context, queue, 1 << 20, threshold);
+
+			return 0;
+		} // end if
+
+		if (sort_size > 0)
+		{
+			run_radix_sort(context, queue, program, sort_size);
+
+			return 0;
+		} // end if
+
 		typedef int mytype;
 
 		// Part 3 - memory allocation
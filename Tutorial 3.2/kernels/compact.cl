@@ -0,0 +1,45 @@
+/*
+a stream compaction (filter) of the elements satisfying a predicate, built with the scan kernels in "my_kernels.cl" (both files form one program);
+the data type and predicate are fixed at build time by definitions in a source string prepended to the program, e.g. "#define COMPACT_TYPE ushort" and
+"#define COMPACT_PREDICATE(x) ((x) > 1000)", and "Compact.h" generates these definitions;
+"compact_flags" flags the elements, "scan_exclusive" turns the flags into output positions, and "compact_scatter" writes the flagged elements and their indices in order
+*/
+#ifndef COMPACT_TYPE
+#define COMPACT_TYPE int
+#endif
+
+#ifndef COMPACT_PREDICATE
+#define COMPACT_PREDICATE(x) ((x) != 0)
+#endif
+
+// flag each element with 1 if it satisfies the predicate or 0 otherwise
+kernel void compact_flags(global const COMPACT_TYPE* A, global uint* flags, const uint N)
+{
+	uint id = get_global_id(0);
+
+	if (id < N)
+		flags[id] = COMPACT_PREDICATE(A[id]) ? 1 : 0;
+} // end function compact_flags
+
+/*
+write each flagged element and its index to its position given by the exclusive scan of the flags;
+the last work item also writes the number of flagged elements to "count", so the count stays on the device and later kernels can be bounded by it without a read
+*/
+kernel void compact_scatter(global const COMPACT_TYPE* A, global const uint* positions, global COMPACT_TYPE* B, global uint* indices, global uint* count, const uint N)
+{
+	uint id = get_global_id(0);
+
+	if (id >= N)
+		return;
+
+	int flag = COMPACT_PREDICATE(A[id]) ? 1 : 0;
+
+	if (flag)
+	{
+		B[positions[id]] = A[id];
+		indices[positions[id]] = id;
+	} // end if
+
+	if (id == N - 1)
+		*count = positions[id] + flag;
+} // end function compact_scatter
\ No newline at end of file
@@ -56,4 +56,278 @@ kernel void scan_add_adjust(global int* A, global const int* B)
 	int id = get_global_id(0);
 	int gid = get_group_id(0);
 	A[id] += B[gid];
-} // end function scan_add_adjust
\ No newline at end of file
+} // end function scan_add_adjust
+
+/*
+the following kernels build a summed-area table (integral image) of a 16-bit single-channel image and use it for box filtering;
+64-bit accumulators are used as the sum of a large 16-bit image can exceed the range of 32-bit integers;
+the table is built by scanning the rows, transposing the row sums, and scanning the rows of the transposed sums (i.e. the columns),
+so the result is the transposed table, which the box filter indexes directly instead of transposing it back
+*/
+
+/*
+a double-buffered Hillis-Steele inclusive scan of the values in "scratch_1" of a work group (the same as "scan_add");
+return the local buffer holding the result
+*/
+local ulong* scan_work_group(local ulong* scratch_1, local ulong* scratch_2)
+{
+	int lid = get_local_id(0);
+	int N = get_local_size(0);
+	local ulong* scratch_3; // used for buffer swap
+
+	barrier(CLK_LOCAL_MEM_FENCE); // wait for all local threads to finish copying from global to local memory
+
+	// "i" represents the stride
+	for (int i = 1; i < N; i *= 2)
+	{
+		if (lid >= i)
+			scratch_2[lid] = scratch_1[lid] + scratch_1[lid - i];
+		else
+			scratch_2[lid] = scratch_1[lid];
+
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		// buffer swap
+		scratch_3 = scratch_2;
+		scratch_2 = scratch_1;
+		scratch_1 = scratch_3;
+	} // end for
+
+	return scratch_1;
+} // end function scan_work_group
+
+/*
+an inclusive scan of each row of "type" values into 64-bit sums with a work group per row;
+the row is scanned in chunks of the work group size, and the total of the previous chunks is carried to the next chunk instead of using block sums;
+the kernel is generated for each element type from this single definition
+*/
+#define SCAN_ROWS(name, type) \
+kernel void name(global const type* A, global ulong* B, local ulong* scratch_1, local ulong* scratch_2, const int width) \
+{ \
+	int lid = get_local_id(0); \
+	int N = get_local_size(0); \
+	int row = get_group_id(1) * width; \
+	ulong carry = 0; \
+\
+	for (int chunk = 0; chunk < width; chunk += N) \
+	{ \
+		int x = chunk + lid; \
+\
+		scratch_1[lid] = x < width ? A[row + x] : 0; \
+\
+		local ulong* result = scan_work_group(scratch_1, scratch_2); \
+\
+		if (x < width) \
+			B[row + x] = result[lid] + carry; \
+\
+		carry += result[N - 1]; \
+\
+		barrier(CLK_LOCAL_MEM_FENCE); /* wait for all local threads to read the chunk total before the scratch buffers are reused */ \
+	} \
+}
+
+SCAN_ROWS(scan_rows_16, ushort) // rows of a 16-bit image
+SCAN_ROWS(scan_rows_64, ulong) // rows of 64-bit values, e.g. the transposed row sums of a summed-area table
+
+#undef SCAN_ROWS
+
+/*
+transpose a matrix of "height" rows and "width" columns through square local memory tiles, so both reading and writing global memory are contiguous;
+"tile" should hold local size * (local size + 1) elements, where the extra column avoids local memory bank conflicts
+*/
+kernel void transpose(global const ulong* A, global ulong* B, local ulong* tile, const int width, const int height)
+{
+	int lx = get_local_id(0);
+	int ly = get_local_id(1);
+	int tile_size = get_local_size(0); // the work group is square
+	int x = get_group_id(0) * tile_size + lx;
+	int y = get_group_id(1) * tile_size + ly;
+
+	if (x < width && y < height)
+		tile[ly * (tile_size + 1) + lx] = A[y * width + x];
+
+	barrier(CLK_LOCAL_MEM_FENCE); // wait for all local threads to finish loading the tile
+
+	// swap the roles of the local coordinates so that consecutive work items write consecutive elements
+	x = get_group_id(1) * tile_size + lx;
+	y = get_group_id(0) * tile_size + ly;
+
+	if (x < height && y < width)
+		B[y * height + x] = tile[lx * (tile_size + 1) + ly];
+} // end function transpose
+
+/*
+a box filter of any radius using a transposed summed-area table, so the cost is 4 lookups per pixel regardless of the radius;
+the window is clipped to the image, and the average is taken over the pixels inside the image
+*/
+kernel void box_filter(global const ulong* SAT_T, global ushort* B, const int width, const int height, const int radius)
+{
+	int x = get_global_id(0);
+	int y = get_global_id(1);
+	int x0 = max(x - radius, 0) - 1; // the column before the window (-1 means none)
+	int y0 = max(y - radius, 0) - 1; // the row before the window (-1 means none)
+	int x1 = min(x + radius, width - 1);
+	int y1 = min(y + radius, height - 1);
+
+	if (x >= width || y >= height)
+		return;
+
+	// the table is transposed, so the sum of the rectangle from (0, 0) to (i, j) is stored at "SAT_T[j + i * height]"
+	ulong sum = SAT_T[y1 + x1 * height];
+
+	if (x0 >= 0)
+		sum -= SAT_T[y1 + x0 * height];
+
+	if (y0 >= 0)
+		sum -= SAT_T[y0 + x1 * height];
+
+	if (x0 >= 0 && y0 >= 0)
+		sum += SAT_T[y0 + x0 * height];
+
+	B[x + y * width] = sum / ((x1 - x0) * (y1 - y0));
+} // end function box_filter
+
+/*
+the following kernels implement an LSD radix sort of 32-bit keys (optionally with 32-bit values) with RADIX_BITS bits per pass;
+each pass counts the digits of each block of a work group ("radix_histogram"), scans the counts of all blocks to get output offsets ("scan_exclusive" and "scan_exclusive_adjust"),
+and scatters the keys of each block to their offsets in a stable way ("radix_scatter")
+*/
+#define RADIX_BITS 4
+#define RADIX (1 << RADIX_BITS)
+
+// a double-buffered Hillis-Steele inclusive scan of the 32-bit values in "scratch_1" of a work group (the same as "scan_work_group")
+local uint* scan_work_group_32(local uint* scratch_1, local uint* scratch_2)
+{
+	int lid = get_local_id(0);
+	int N = get_local_size(0);
+	local uint* scratch_3; // used for buffer swap
+
+	barrier(CLK_LOCAL_MEM_FENCE); // wait for all local threads to finish copying to local memory
+
+	// "i" represents the stride
+	for (int i = 1; i < N; i *= 2)
+	{
+		if (lid >= i)
+			scratch_2[lid] = scratch_1[lid] + scratch_1[lid - i];
+		else
+			scratch_2[lid] = scratch_1[lid];
+
+		barrier(CLK_LOCAL_MEM_FENCE);
+
+		// buffer swap
+		scratch_3 = scratch_2;
+		scratch_2 = scratch_1;
+		scratch_1 = scratch_3;
+	} // end for
+
+	return scratch_1;
+} // end function scan_work_group_32
+
+/*
+count the digits of each block of keys;
+the counts are stored digit by digit ("histograms[digit * group_count + group]"), so an exclusive scan of them gives the output offset of each digit of each block
+*/
+kernel void radix_histogram(global const uint* keys, global uint* histograms, local uint* local_histogram, const int shift, const uint N)
+{
+	uint id = get_global_id(0);
+	int lid = get_local_id(0);
+	int local_size = get_local_size(0);
+
+	for (int i = lid; i < RADIX; i += local_size)
+		local_histogram[i] = 0;
+
+	barrier(CLK_LOCAL_MEM_FENCE); // wait for all local threads to finish clearing the local histogram
+
+	if (id < N)
+		atomic_inc(&local_histogram[(keys[id] >> shift) & (RADIX - 1)]);
+
+	barrier(CLK_LOCAL_MEM_FENCE); // wait for all local threads to finish counting
+
+	for (int i = lid; i < RADIX; i += local_size)
+		histograms[i * get_num_groups(0) + get_group_id(0)] = local_histogram[i];
+} // end function radix_histogram
+
+// an in-place exclusive scan of each block of a work group; the total of each block is written to "block_sums"
+kernel void scan_exclusive(global uint* A, global uint* block_sums, local uint* scratch_1, local uint* scratch_2, const uint N)
+{
+	uint id = get_global_id(0);
+	int lid = get_local_id(0);
+	uint value = id < N ? A[id] : 0;
+
+	scratch_1[lid] = value;
+
+	local uint* result = scan_work_group_32(scratch_1, scratch_2);
+
+	if (id < N)
+		A[id] = result[lid] - value; // the exclusive scan excludes the value itself
+
+	if (lid == get_local_size(0) - 1)
+		block_sums[get_group_id(0)] = result[lid];
+} // end function scan_exclusive
+
+// add the scanned block sums to corresponding blocks (the same as "scan_add_adjust" with a bound)
+kernel void scan_exclusive_adjust(global uint* A, global const uint* block_sums, const uint N)
+{
+	uint id = get_global_id(0);
+
+	if (id < N)
+		A[id] += block_sums[get_group_id(0)];
+} // end function scan_exclusive_adjust
+
+/*
+scatter the keys (and values) of each block to their sorted positions for a pass;
+the block is first sorted by the digit in local memory with RADIX_BITS stable 1-bit splits, each using a work group scan,
+so the rank of a key among the keys of the same digit in the block is its local position minus the first local position of the digit;
+keys beyond N are padded with the largest key, so they stay after all valid keys of the block and are not written;
+"local_keys", "local_values", "scratch_1", and "scratch_2" should hold local size elements each
+*/
+kernel void radix_scatter(global const uint* keys, global const uint* values, global uint* sorted_keys, global uint* sorted_values, global const uint* offsets,
+	local uint* local_keys, local uint* local_values, local uint* scratch_1, local uint* scratch_2, const int shift, const uint N, const int has_values)
+{
+	local uint digit_start[RADIX];
+	uint id = get_global_id(0);
+	int lid = get_local_id(0);
+	int local_size = get_local_size(0);
+	uint valid_count = min((uint)local_size, N - get_group_id(0) * local_size); // the number of valid keys in the block
+	uint key = id < N ? keys[id] : UINT_MAX;
+	uint value = (has_values && id < N) ? values[id] : 0;
+
+	for (int bit = shift; bit < shift + RADIX_BITS; bit++)
+	{
+		uint is_one = (key >> bit) & 1;
+
+		scratch_1[lid] = !is_one;
+
+		local uint* result = scan_work_group_32(scratch_1, scratch_2);
+		uint zeros_before = result[lid] - !is_one;
+		uint zero_count = result[local_size - 1];
+		uint position = is_one ? zero_count + lid - zeros_before : zeros_before;
+
+		local_keys[position] = key;
+		local_values[position] = value;
+
+		barrier(CLK_LOCAL_MEM_FENCE); // wait for all local threads to finish the split
+
+		key = local_keys[lid];
+		value = local_values[lid];
+
+		barrier(CLK_LOCAL_MEM_FENCE); // wait for all local threads to read their keys before the next split
+	} // end for
+
+	uint digit = (key >> shift) & (RADIX - 1);
+
+	if (lid == 0 || ((local_keys[lid - 1] >> shift) & (RADIX - 1)) != digit)
+		digit_start[digit] = lid;
+
+	barrier(CLK_LOCAL_MEM_FENCE); // wait for all local threads to finish recording the first positions of digits
+
+	if (lid < valid_count)
+	{
+		uint position = offsets[digit * get_num_groups(0) + get_group_id(0)] + lid - digit_start[digit];
+
+		sorted_keys[position] = key;
+
+		if (has_values)
+			sorted_values[position] = value;
+	} // end if
+} // end function radix_scatter
\ No newline at end of file
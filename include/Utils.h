@@ -213,6 +213,55 @@ cl::Context GetContext(int platform_id, int device_id)
 	return cl::Context();
 } // end function GetContext
 
+// get all devices of all platforms (a context cannot span platforms, so each device needs its own context)
+vector<cl::Device> GetAllDevices()
+{
+	vector<cl::Platform> platforms;
+	vector<cl::Device> all_devices;
+
+	cl::Platform::get(&platforms);
+
+	for (unsigned int i = 0; i < platforms.size(); i++)
+	{
+		vector<cl::Device> devices;
+		platforms[i].getDevices((cl_device_type)CL_DEVICE_TYPE_ALL, &devices);
+		all_devices.insert(all_devices.end(), devices.begin(), devices.end());
+	} // end for
+
+	return all_devices;
+} // end function GetAllDevices
+
+/*
+partition a device into sub-devices by NUMA node (device fission by affinity domain);
+the device itself is returned if it cannot be partitioned (e.g. a GPU or a single-socket CPU)
+*/
+vector<cl::Device> GetNUMASubDevices(int platform_id, int device_id)
+{
+	vector<cl::Platform> platforms;
+	vector<cl::Device> devices;
+	vector<cl::Device> sub_devices;
+
+	cl::Platform::get(&platforms);
+	platforms[platform_id].getDevices((cl_device_type)CL_DEVICE_TYPE_ALL, &devices);
+
+	const cl_device_partition_property properties[] = { CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN, CL_DEVICE_AFFINITY_DOMAIN_NUMA, 0 };
+
+	try
+	{
+		devices[device_id].createSubDevices(properties, &sub_devices);
+	}
+	catch (const cl::Error&)
+	{
+		// CL_DEVICE_PARTITION_FAILED, CL_INVALID_VALUE, etc. mean that partitioning by NUMA node is not supported
+		sub_devices.clear();
+	} // end try...catch
+
+	if (sub_devices.empty())
+		sub_devices.push_back(devices[device_id]);
+
+	return sub_devices;
+} // end function GetNUMASubDevices
+
 enum class ProfilingResolution
 {
 	PROF_NS = 1,
@@ -221,15 +270,35 @@ enum class ProfilingResolution
 	PROF_S = 1000000000
 };
 
+// the durations in nanoseconds of the stages of a profiled command
+struct ProfilingStages
+{
+	cl_ulong queued; // from being queued to being submitted to the device
+	cl_ulong submitted; // from being submitted to starting execution
+	cl_ulong executed; // from starting to ending execution
+	cl_ulong total; // from being queued to ending execution
+};
+
+ProfilingStages GetProfilingStages(const cl::Event& evnt)
+{
+	cl_ulong queued = evnt.getProfilingInfo<CL_PROFILING_COMMAND_QUEUED>();
+	cl_ulong submit = evnt.getProfilingInfo<CL_PROFILING_COMMAND_SUBMIT>();
+	cl_ulong start = evnt.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+	cl_ulong end = evnt.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+
+	return { submit - queued, start - submit, end - start, end - queued };
+} // end function GetProfilingStages
+
 string GetFullProfilingInfo(const cl::Event& evnt, ProfilingResolution resolutionSelection)
 {
 	stringstream sstream;
 	auto resolution = static_cast<int>(resolutionSelection);
+	ProfilingStages stages = GetProfilingStages(evnt);
 
-	sstream << "Queued " << (evnt.getProfilingInfo<CL_PROFILING_COMMAND_SUBMIT>() - evnt.getProfilingInfo<CL_PROFILING_COMMAND_QUEUED>()) / resolution;
-	sstream << ", Submitted " << (evnt.getProfilingInfo<CL_PROFILING_COMMAND_START>() - evnt.getProfilingInfo<CL_PROFILING_COMMAND_SUBMIT>()) / resolution;
-	sstream << ", Executed " << (evnt.getProfilingInfo<CL_PROFILING_COMMAND_END>() - evnt.getProfilingInfo<CL_PROFILING_COMMAND_START>()) / resolution;
-	sstream << ", Total " << (evnt.getProfilingInfo<CL_PROFILING_COMMAND_END>() - evnt.getProfilingInfo<CL_PROFILING_COMMAND_QUEUED>()) / resolution;
+	sstream << "Queued " << stages.queued / resolution;
+	sstream << ", Submitted " << stages.submitted / resolution;
+	sstream << ", Executed " << stages.executed / resolution;
+	sstream << ", Total " << stages.total / resolution;
 
 	return sstream.str();
 } // end function GetFullProfilingInfo
\ No newline at end of file